@@ -0,0 +1,768 @@
+#include "ast.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "functions.h"
+#include "heap.h"
+
+static auto heap = GetHeap();
+
+Node::Node(NodeKind kind) : Object(ObjectType::Node), kind(kind) {
+}
+Object* Node::Copy() const {
+    throw std::runtime_error("node is not copyable");
+}
+std::string Node::ToString() const {
+    return "<node>";
+}
+// Children of the node, and the values kept by constants, folds and specialized calls.
+void Node::Trace(std::vector<Object*>* edges) const {
+    auto children = GetChildren(const_cast<Node*>(this));
+    edges->insert(edges->end(), children.begin(), children.end());
+    switch (kind) {
+        case NodeKind::Constant:
+            edges->push_back(static_cast<const ConstantNode*>(this)->value);
+            break;
+        case NodeKind::Call:
+            edges->push_back(static_cast<const CallNode*>(this)->GetCachedCallee());
+            break;
+        case NodeKind::Folded: {
+            auto folded = static_cast<const FoldedNode*>(this);
+            edges->push_back(folded->value);
+            for (auto& guard : folded->guards) {
+                edges->push_back(guard.expected);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+ConstantNode::ConstantNode(Object* value) : Node(NodeKind::Constant), value(value) {
+}
+
+VariableNode::VariableNode(SymbolId name) : Node(NodeKind::Variable), name(name) {
+}
+Binding* VariableNode::GetCachedBinding(Scope* globals) const {
+    if (cached_globals_ != globals) {
+        return nullptr;
+    }
+    return cached_binding_;
+}
+void VariableNode::CacheBinding(Scope* globals, Binding* binding) {
+    cached_globals_ = globals;
+    cached_binding_ = binding;
+}
+
+IfNode::IfNode(Node* condition, Node* consequent, Node* alternative)
+    : Node(NodeKind::If),
+      condition(condition),
+      consequent(consequent),
+      alternative(alternative) {
+}
+
+AssignNode::AssignNode(NodeKind kind, SymbolId name, Node* value)
+    : Node(kind), name(name), value(value) {
+}
+
+static bool ContainsLambda(Node* node) {
+    if (node->kind == NodeKind::Lambda) {
+        return true;
+    }
+    for (auto child : GetChildren(node)) {
+        if (ContainsLambda(child)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct LocalName {
+    SymbolId name;
+    // the value is unknown from the code
+    bool argument;
+};
+
+static void ScanEffects(Node* node, std::vector<LocalName>* locals, LambdaEffects* effects);
+
+static void ScanLambdaEffects(const std::vector<SymbolId>& arguments,
+                              const std::vector<Node*>& body, std::vector<LocalName>* locals,
+                              LambdaEffects* effects) {
+    auto scope_size = locals->size();
+    for (auto name : arguments) {
+        locals->push_back({name, true});
+    }
+    for (auto name : GetInternalDefines(body)) {
+        locals->push_back({name, false});
+    }
+    for (auto child : body) {
+        ScanEffects(child, locals, effects);
+    }
+    locals->resize(scope_size);
+}
+
+// Nested lambdas may assign and call names of the enclosing ones, these are in locals.
+static void ScanEffects(Node* node, std::vector<LocalName>* locals, LambdaEffects* effects) {
+    static const auto set_car = Intern("set-car!");
+    static const auto set_cdr = Intern("set-cdr!");
+    static const auto vector_set = Intern("vector-set!");
+    static const auto vector_fill = Intern("vector-fill!");
+    auto find_local = [locals](SymbolId name) -> const LocalName* {
+        auto it = std::find_if(locals->rbegin(), locals->rend(),
+                               [name](const LocalName& local) { return local.name == name; });
+        return it == locals->rend() ? nullptr : &*it;
+    };
+    auto read_variable = [&](SymbolId name) {
+        if (find_local(name)) {
+            return;
+        }
+        if (name == set_car || name == set_cdr || name == vector_set || name == vector_fill) {
+            effects->mutates_outer_state = true;
+        }
+        auto& free_names = effects->free_names;
+        if (std::find(free_names.begin(), free_names.end(), name) == free_names.end()) {
+            free_names.push_back(name);
+        }
+    };
+    switch (node->kind) {
+        case NodeKind::Variable:
+            read_variable(static_cast<VariableNode*>(node)->name);
+            return;
+        case NodeKind::Set:
+            if (!find_local(static_cast<AssignNode*>(node)->name)) {
+                effects->mutates_outer_state = true;
+            }
+            break;
+        case NodeKind::Call: {
+            auto call = static_cast<CallNode*>(node);
+            auto callee = call->callee;
+            if (callee->kind == NodeKind::Variable) {
+                auto name = static_cast<VariableNode*>(callee)->name;
+                auto local = find_local(name);
+                if (local && local->argument) {
+                    effects->mutates_outer_state = true;
+                }
+                read_variable(name);
+            } else if (callee->kind != NodeKind::Lambda) {
+                effects->mutates_outer_state = true;
+            }
+            for (auto child : GetChildren(node)) {
+                ScanEffects(child, locals, effects);
+            }
+            return;
+        }
+        case NodeKind::Let:
+        case NodeKind::Letrec:
+        case NodeKind::Loop: {
+            auto let = static_cast<LetNode*>(node);
+            auto scope_size = locals->size();
+            for (auto value : let->values) {
+                if (node->kind == NodeKind::Letrec) {
+                    for (auto name : let->scope_names) {
+                        locals->push_back({name, false});
+                    }
+                }
+                ScanEffects(value, locals, effects);
+                locals->resize(scope_size);
+            }
+            for (auto name : let->scope_names) {
+                locals->push_back({name, false});
+            }
+            for (auto body : let->body) {
+                ScanEffects(body, locals, effects);
+            }
+            locals->resize(scope_size);
+            return;
+        }
+        case NodeKind::Lambda: {
+            auto lambda = static_cast<LambdaNode*>(node);
+            ScanLambdaEffects(lambda->arguments, lambda->body, locals, effects);
+            return;
+        }
+        default:
+            break;
+    }
+    for (auto child : GetChildren(node)) {
+        ScanEffects(child, locals, effects);
+    }
+}
+
+LambdaNode::LambdaNode(std::vector<SymbolId> arguments, std::vector<Node*> body)
+    : LambdaNode(arguments, body, [&] {
+          LambdaEffects effects;
+          std::vector<LocalName> locals;
+          ScanLambdaEffects(arguments, body, &locals, &effects);
+          return effects;
+      }()) {
+}
+
+LambdaNode::LambdaNode(std::vector<SymbolId> arguments, std::vector<Node*> body,
+                       LambdaEffects effects)
+    : Node(NodeKind::Lambda),
+      arguments(std::move(arguments)),
+      body(std::move(body)),
+      creates_lambdas(std::any_of(this->body.begin(), this->body.end(), ContainsLambda)),
+      mutates_outer_state(effects.mutates_outer_state),
+      free_names(std::move(effects.free_names)) {
+}
+
+static std::vector<SymbolId> GetScopeNames(NodeKind kind, std::vector<SymbolId> names,
+                                           const std::vector<Node*>& values,
+                                           const std::vector<Node*>& body) {
+    auto add = [&names](const std::vector<SymbolId>& defines) {
+        for (auto name : defines) {
+            if (std::find(names.begin(), names.end(), name) == names.end()) {
+                names.push_back(name);
+            }
+        }
+    };
+    if (kind == NodeKind::Letrec) {
+        add(GetInternalDefines(values));
+    }
+    add(GetInternalDefines(body));
+    return names;
+}
+
+LetNode::LetNode(NodeKind kind, std::vector<SymbolId> names, std::vector<Node*> values,
+                 std::vector<Node*> body)
+    : Node(kind),
+      names(std::move(names)),
+      values(std::move(values)),
+      body(std::move(body)),
+      scope_names(GetScopeNames(kind, this->names, this->values, this->body)),
+      creates_lambdas(std::any_of(this->values.begin(), this->values.end(), ContainsLambda) ||
+                      std::any_of(this->body.begin(), this->body.end(), ContainsLambda)) {
+}
+
+RecurNode::RecurNode(std::vector<Node*> arguments)
+    : Node(NodeKind::Recur), arguments(std::move(arguments)) {
+}
+
+LogicalNode::LogicalNode(NodeKind kind, std::vector<Node*> operands)
+    : Node(kind), operands(std::move(operands)) {
+}
+
+CallNode::CallNode(Node* callee, std::vector<Node*> arguments, bool improper)
+    : Node(NodeKind::Call), callee(callee), arguments(std::move(arguments)), improper(improper) {
+}
+
+CallState CallNode::GetState() const {
+    return state_;
+}
+Object* CallNode::GetCachedCallee() const {
+    return cached_callee_;
+}
+void CallNode::Specialize(CallState state, Object* callee) {
+    state_ = state;
+    cached_callee_ = callee;
+}
+void CallNode::Deoptimize() {
+    Specialize(CallState::Generic, nullptr);
+}
+
+FoldedNode::FoldedNode(Object* value, Node* original, std::vector<BindingGuard> guards)
+    : Node(NodeKind::Folded), value(value), original(original), guards(std::move(guards)) {
+}
+bool FoldedNode::Holds() const {
+    for (auto& guard : guards) {
+        if (guard.binding->value != guard.expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<Node*> GetChildren(Node* node) {
+    switch (node->kind) {
+        case NodeKind::Constant:
+        case NodeKind::Variable:
+            return {};
+        case NodeKind::If: {
+            auto if_node = static_cast<IfNode*>(node);
+            if (if_node->alternative == nullptr) {
+                return {if_node->condition, if_node->consequent};
+            }
+            return {if_node->condition, if_node->consequent, if_node->alternative};
+        }
+        case NodeKind::Define:
+        case NodeKind::Set:
+            return {static_cast<AssignNode*>(node)->value};
+        case NodeKind::Lambda:
+            return static_cast<LambdaNode*>(node)->body;
+        case NodeKind::And:
+        case NodeKind::Or:
+            return static_cast<LogicalNode*>(node)->operands;
+        case NodeKind::Call: {
+            auto call = static_cast<CallNode*>(node);
+            std::vector<Node*> children{call->callee};
+            children.insert(children.end(), call->arguments.begin(), call->arguments.end());
+            return children;
+        }
+        case NodeKind::Folded:
+            return {static_cast<FoldedNode*>(node)->original};
+        case NodeKind::Let:
+        case NodeKind::Letrec:
+        case NodeKind::Loop: {
+            auto let = static_cast<LetNode*>(node);
+            std::vector<Node*> children = let->values;
+            children.insert(children.end(), let->body.begin(), let->body.end());
+            return children;
+        }
+        case NodeKind::Recur:
+            return static_cast<RecurNode*>(node)->arguments;
+    }
+    return {};
+}
+
+static void CollectDefines(Node* node, std::vector<SymbolId>* names) {
+    if (node->kind == NodeKind::Lambda || node->kind == NodeKind::Letrec) {
+        return;
+    }
+    if (node->kind == NodeKind::Let || node->kind == NodeKind::Loop) {
+        for (auto value : static_cast<LetNode*>(node)->values) {
+            CollectDefines(value, names);
+        }
+        return;
+    }
+    if (node->kind == NodeKind::Define) {
+        auto name = static_cast<AssignNode*>(node)->name;
+        if (std::find(names->begin(), names->end(), name) == names->end()) {
+            names->push_back(name);
+        }
+    }
+    for (auto child : GetChildren(node)) {
+        CollectDefines(child, names);
+    }
+}
+
+std::vector<SymbolId> GetInternalDefines(const std::vector<Node*>& body) {
+    std::vector<SymbolId> names;
+    for (auto node : body) {
+        CollectDefines(node, &names);
+    }
+    return names;
+}
+
+static AstBuilder::Forms GetForms(const std::string& name, Object* arguments) {
+    auto [status, forms] = ToVector(arguments);
+    if (status == ImproperList) {
+        throw SyntaxError("improper list can't be interpreted as arguments for function '" + name +
+                          "'.");
+    }
+    return forms;
+}
+
+static void CheckCount(const std::string& name, const AstBuilder::Forms& forms, size_t min_arg,
+                       size_t max_arg, bool syntax_error) {
+    std::string message;
+    if (forms.size() < min_arg) {
+        message = "not enough argyments for function '" + name + "'.";
+        message += " Exepected at least " + std::to_string(min_arg);
+    } else if (forms.size() > max_arg) {
+        message = "too many argyments for function '" + name + "'.";
+        message += " Exepected at most " + std::to_string(max_arg);
+    } else {
+        return;
+    }
+    message += ", but got " + std::to_string(forms.size()) + ".";
+    if (syntax_error) {
+        throw SyntaxError(message);
+    }
+    throw RuntimeError(message);
+}
+
+Node* AstBuilder::Build(Object* form) {
+    if (form == nullptr) {
+        throw RuntimeError("can't execute nullptr");
+    }
+    if (Is<Symbol>(form)) {
+        return heap->Make<VariableNode>(As<Symbol>(form)->GetId());
+    }
+    if (!Is<Cell>(form)) {
+        return heap->Make<ConstantNode>(form);
+    }
+    auto call = As<Cell>(form);
+    if (Is<Symbol>(call->GetFirst())) {
+        if (auto node = BuildSpecialForm(As<Symbol>(call->GetFirst())->GetName(),
+                                         call->GetSecond())) {
+            return node;
+        }
+    }
+    auto callee = Build(call->GetFirst());
+    auto [status, forms] = ToVector(call->GetSecond());
+    if (status == ImproperList) {
+        return heap->Make<CallNode>(callee, std::vector<Node*>{}, true);
+    }
+    return heap->Make<CallNode>(callee, BuildBody(forms, 0), false);
+}
+
+// nullptr if name is not a special form
+Node* AstBuilder::BuildSpecialForm(const std::string& name, Object* arguments) {
+    if (name == "quote") {
+        return BuildQuote(GetForms(name, arguments));
+    }
+    if (name == "if") {
+        return BuildIf(GetForms(name, arguments));
+    }
+    if (name == "define") {
+        return BuildDefine(GetForms(name, arguments));
+    }
+    if (name == "define-memoized") {
+        return BuildDefineMemoized(GetForms(name, arguments));
+    }
+    if (name == "set!") {
+        return BuildSet(GetForms(name, arguments));
+    }
+    if (name == "lambda") {
+        auto forms = GetForms(name, arguments);
+        CheckCount(name, forms, 2, -1, true);
+        return BuildLambda(ToVector(forms[0]).second, 0, forms);
+    }
+    if (name == "let" || name == "let*" || name == "letrec") {
+        return BuildLet(name, GetForms(name, arguments));
+    }
+    if (name == "do") {
+        return BuildDo(GetForms(name, arguments));
+    }
+    if (name == "and") {
+        return BuildLogical(NodeKind::And, GetForms(name, arguments));
+    }
+    if (name == "or") {
+        return BuildLogical(NodeKind::Or, GetForms(name, arguments));
+    }
+    return nullptr;
+}
+
+std::vector<Node*> AstBuilder::BuildBody(const Forms& forms, size_t from) {
+    std::vector<Node*> nodes;
+    for (size_t i = from; i < forms.size(); ++i) {
+        nodes.push_back(Build(forms[i]));
+    }
+    return nodes;
+}
+
+Node* AstBuilder::BuildQuote(const Forms& arguments) {
+    CheckCount("quote", arguments, 1, 1, false);
+    return heap->Make<ConstantNode>(arguments[0]);
+}
+
+Node* AstBuilder::BuildIf(const Forms& arguments) {
+    CheckCount("if", arguments, 2, 3, true);
+    auto condition = Build(arguments[0]);
+    auto consequent = Build(arguments[1]);
+    Node* alternative = nullptr;
+    if (arguments.size() == 3) {
+        alternative = Build(arguments[2]);
+    }
+    return heap->Make<IfNode>(condition, consequent, alternative);
+}
+
+Node* AstBuilder::BuildDefine(const Forms& arguments) {
+    CheckCount("define", arguments, 2, -1, true);
+    if (Is<Symbol>(arguments[0])) {
+        if (arguments.size() > 2) {
+            throw SyntaxError("too many arguments for function 'define'");
+        }
+        return heap->Make<AssignNode>(NodeKind::Define, As<Symbol>(arguments[0])->GetId(),
+                                      Build(arguments[1]));
+    }
+    // lambda sugar
+    if (!Is<Cell>(arguments[0])) {
+        throw SyntaxError("incorrect usage of define");
+    }
+    auto [_, lambda_params] = ToVector(arguments[0]);
+    if (!Is<Symbol>(lambda_params[0])) {
+        throw SyntaxError("incorrect function name");
+    }
+    return heap->Make<AssignNode>(NodeKind::Define, As<Symbol>(lambda_params[0])->GetId(),
+                                  BuildLambda(lambda_params, 1, arguments));
+}
+
+// (define-memoized (f args...) body...) is (define f (memoize (lambda (args...) body...))),
+// with the memoize builtin itself, so it does not depend on the global name.
+Node* AstBuilder::BuildDefineMemoized(const Forms& arguments) {
+    CheckCount("define-memoized", arguments, 2, -1, true);
+    if (!Is<Cell>(arguments[0])) {
+        throw SyntaxError("incorrect usage of define-memoized");
+    }
+    auto [_, lambda_params] = ToVector(arguments[0]);
+    if (!Is<Symbol>(lambda_params[0])) {
+        throw SyntaxError("incorrect function name");
+    }
+    auto lambda = static_cast<LambdaNode*>(BuildLambda(lambda_params, 1, arguments));
+    if (lambda->mutates_outer_state) {
+        throw SyntaxError("function with side effects can't be memoized");
+    }
+    auto memoize = heap->Make<ConstantNode>(heap->Make<Memoize>());
+    return heap->Make<AssignNode>(NodeKind::Define, As<Symbol>(lambda_params[0])->GetId(),
+                                  heap->Make<CallNode>(memoize, std::vector<Node*>{lambda}, false));
+}
+
+Node* AstBuilder::BuildSet(const Forms& arguments) {
+    CheckCount("set!", arguments, 2, 2, true);
+    if (!Is<Symbol>(arguments[0])) {
+        throw RuntimeError("argument #0 for function set! shoud be Symbol");
+    }
+    return heap->Make<AssignNode>(NodeKind::Set, As<Symbol>(arguments[0])->GetId(),
+                                  Build(arguments[1]));
+}
+
+// body is forms[1:], the same for both lambda and define sugar
+Node* AstBuilder::BuildLambda(const Forms& params, size_t from, const Forms& forms) {
+    std::vector<SymbolId> arguments;
+    for (size_t i = from; i < params.size(); ++i) {
+        if (!Is<Symbol>(params[i])) {
+            throw RuntimeError("only symbols could be lambda arguments.");
+        }
+        arguments.push_back(As<Symbol>(params[i])->GetId());
+    }
+    return heap->Make<LambdaNode>(std::move(arguments), BuildBody(forms, 1));
+}
+
+Node* AstBuilder::BuildLogical(NodeKind kind, const Forms& arguments) {
+    if (arguments.empty()) {
+        return heap->Make<ConstantNode>(Boolean(kind == NodeKind::And));
+    }
+    return heap->Make<LogicalNode>(kind, BuildBody(arguments, 0));
+}
+
+// (let ((name value) ...) body...), let* becomes a let of the first binding around
+// a let* of the others.
+Node* AstBuilder::BuildLet(const std::string& name, const Forms& arguments) {
+    CheckCount(name, arguments, 2, -1, true);
+    if (name == "let" && Is<Symbol>(arguments[0])) {
+        return BuildNamedLet(arguments);
+    }
+    auto [names, values, _] = BuildBindings(name, arguments[0], false);
+    auto body = BuildBody(arguments, 1);
+    auto kind = name == "letrec" ? NodeKind::Letrec : NodeKind::Let;
+    if (name != "let*" || names.size() <= 1) {
+        return heap->Make<LetNode>(kind, std::move(names), std::move(values), std::move(body));
+    }
+    for (size_t i = names.size(); i-- > 0;) {
+        body = {heap->Make<LetNode>(kind, std::vector<SymbolId>{names[i]},
+                                    std::vector<Node*>{values[i]}, std::move(body))};
+    }
+    return body[0];
+}
+
+AstBuilder::Bindings AstBuilder::BuildBindings(const std::string& form, Object* bindings,
+                                               bool steps) {
+    auto [status, forms] = ToVector(bindings);
+    if (status == ImproperList) {
+        throw SyntaxError("bindings of '" + form + "' should be a list");
+    }
+    Bindings result;
+    for (auto binding : forms) {
+        auto [binding_status, parts] = ToVector(binding);
+        if (!Is<Cell>(binding) || binding_status == ImproperList || parts.size() < 2 ||
+            parts.size() > (steps ? 3 : 2) || !Is<Symbol>(parts[0])) {
+            throw SyntaxError("incorrect binding in '" + form + "'");
+        }
+        auto& names = result.names;
+        names.push_back(As<Symbol>(parts[0])->GetId());
+        if (form != "let*" &&
+            std::find(names.begin(), names.end() - 1, names.back()) != names.end() - 1) {
+            throw SyntaxError("name '" + GetSymbolName(names.back()) + "' is bound twice in '" +
+                              form + "'");
+        }
+        result.values.push_back(Build(parts[1]));
+        if (steps) {
+            result.steps.push_back(parts.size() == 3 ? Build(parts[2])
+                                                     : heap->Make<VariableNode>(names.back()));
+        }
+    }
+    return result;
+}
+
+static bool ContainsName(Node* node, SymbolId name) {
+    if ((node->kind == NodeKind::Variable && static_cast<VariableNode*>(node)->name == name) ||
+        ((node->kind == NodeKind::Define || node->kind == NodeKind::Set) &&
+         static_cast<AssignNode*>(node)->name == name)) {
+        return true;
+    }
+    for (auto child : GetChildren(node)) {
+        if (ContainsName(child, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static Node* ToRecur(Node* node, SymbolId name, size_t arity, bool tail);
+
+// The last node is in the tail position if tail is set. False if any node can't be rewritten.
+static bool ToRecurAll(const std::vector<Node*>& nodes, SymbolId name, size_t arity, bool tail,
+                       std::vector<Node*>* result, bool* changed) {
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        auto rewritten = ToRecur(nodes[i], name, arity, tail && i + 1 == nodes.size());
+        if (rewritten == nullptr) {
+            return false;
+        }
+        result->push_back(rewritten);
+        *changed |= rewritten != nodes[i];
+    }
+    return true;
+}
+
+// Rewrites the calls of a named let in the tail positions of its body to recur nodes.
+// nullptr if the name is used in any other way, then the named let needs a real lambda.
+// Recur nodes only run the innermost loop, so the body of a nested loop is not a tail position.
+static Node* ToRecur(Node* node, SymbolId name, size_t arity, bool tail) {
+    bool changed = false;
+    switch (node->kind) {
+        case NodeKind::Constant:
+        case NodeKind::Folded:
+            return node;
+        case NodeKind::Variable:
+        case NodeKind::Lambda:
+            return ContainsName(node, name) ? nullptr : node;
+        case NodeKind::If: {
+            auto if_node = static_cast<IfNode*>(node);
+            auto condition = ToRecur(if_node->condition, name, arity, false);
+            auto consequent = ToRecur(if_node->consequent, name, arity, tail);
+            Node* alternative = nullptr;
+            if (if_node->alternative != nullptr) {
+                alternative = ToRecur(if_node->alternative, name, arity, tail);
+                if (alternative == nullptr) {
+                    return nullptr;
+                }
+            }
+            if (condition == nullptr || consequent == nullptr) {
+                return nullptr;
+            }
+            if (condition == if_node->condition && consequent == if_node->consequent &&
+                alternative == if_node->alternative) {
+                return node;
+            }
+            return heap->Make<IfNode>(condition, consequent, alternative);
+        }
+        case NodeKind::Define:
+        case NodeKind::Set: {
+            auto assign = static_cast<AssignNode*>(node);
+            if (assign->name == name) {
+                return nullptr;
+            }
+            auto value = ToRecur(assign->value, name, arity, false);
+            if (value == nullptr || value == assign->value) {
+                return value;
+            }
+            return heap->Make<AssignNode>(node->kind, assign->name, value);
+        }
+        case NodeKind::And:
+        case NodeKind::Or: {
+            std::vector<Node*> operands;
+            if (!ToRecurAll(static_cast<LogicalNode*>(node)->operands, name, arity, tail,
+                            &operands, &changed)) {
+                return nullptr;
+            }
+            return changed ? heap->Make<LogicalNode>(node->kind, std::move(operands)) : node;
+        }
+        case NodeKind::Call: {
+            auto call = static_cast<CallNode*>(node);
+            std::vector<Node*> arguments;
+            if (!ToRecurAll(call->arguments, name, arity, false, &arguments, &changed)) {
+                return nullptr;
+            }
+            if (tail && !call->improper && call->arguments.size() == arity &&
+                call->callee->kind == NodeKind::Variable &&
+                static_cast<VariableNode*>(call->callee)->name == name) {
+                return heap->Make<RecurNode>(std::move(arguments));
+            }
+            auto callee = ToRecur(call->callee, name, arity, false);
+            if (callee == nullptr) {
+                return nullptr;
+            }
+            if (!changed && callee == call->callee) {
+                return node;
+            }
+            return heap->Make<CallNode>(callee, std::move(arguments), call->improper);
+        }
+        case NodeKind::Let:
+        case NodeKind::Letrec:
+        case NodeKind::Loop: {
+            auto let = static_cast<LetNode*>(node);
+            auto& names = let->scope_names;
+            if (std::find(names.begin(), names.end(), name) != names.end()) {
+                return ContainsName(node, name) ? nullptr : node;
+            }
+            std::vector<Node*> values;
+            std::vector<Node*> body;
+            if (!ToRecurAll(let->values, name, arity, false, &values, &changed) ||
+                !ToRecurAll(let->body, name, arity, tail && node->kind != NodeKind::Loop, &body,
+                            &changed)) {
+                return nullptr;
+            }
+            if (!changed) {
+                return node;
+            }
+            return heap->Make<LetNode>(node->kind, let->names, std::move(values), std::move(body));
+        }
+        case NodeKind::Recur: {
+            std::vector<Node*> arguments;
+            if (!ToRecurAll(static_cast<RecurNode*>(node)->arguments, name, arity, false,
+                            &arguments, &changed)) {
+                return nullptr;
+            }
+            return changed ? heap->Make<RecurNode>(std::move(arguments)) : node;
+        }
+    }
+    return node;
+}
+
+// (let name ((arg value) ...) body...) is a loop, when name is only called in the tail
+// positions of the body. Otherwise it is ((letrec ((name (lambda (arg ...) body...))) name)
+// value ...).
+Node* AstBuilder::BuildNamedLet(const Forms& arguments) {
+    CheckCount("let", arguments, 3, -1, true);
+    auto name = As<Symbol>(arguments[0])->GetId();
+    auto [names, values, _] = BuildBindings("let", arguments[1], false);
+    auto body = BuildBody(arguments, 2);
+    std::vector<Node*> loop_body;
+    bool changed = false;
+    if (ToRecurAll(body, name, names.size(), true, &loop_body, &changed)) {
+        return heap->Make<LetNode>(NodeKind::Loop, std::move(names), std::move(values),
+                                   std::move(loop_body));
+    }
+    auto lambda = heap->Make<LambdaNode>(std::move(names), std::move(body));
+    auto letrec = heap->Make<LetNode>(NodeKind::Letrec, std::vector<SymbolId>{name},
+                                      std::vector<Node*>{lambda},
+                                      std::vector<Node*>{heap->Make<VariableNode>(name)});
+    return heap->Make<CallNode>(letrec, std::move(values), false);
+}
+
+// (do ((name value step) ...) (test result...) command...) is a loop, that checks the test,
+// and then either evaluates the results or the commands and the next iteration.
+Node* AstBuilder::BuildDo(const Forms& arguments) {
+    CheckCount("do", arguments, 2, -1, true);
+    auto [names, values, steps] = BuildBindings("do", arguments[0], true);
+    auto [status, exit] = ToVector(arguments[1]);
+    if (!Is<Cell>(arguments[1]) || status == ImproperList) {
+        throw SyntaxError("'do' should have a test clause");
+    }
+    // a let without names is a sequence of expressions
+    auto sequence = [](std::vector<Node*> nodes) -> Node* {
+        if (nodes.size() == 1) {
+            return nodes[0];
+        }
+        return heap->Make<LetNode>(NodeKind::Let, std::vector<SymbolId>{},
+                                   std::vector<Node*>{}, std::move(nodes));
+    };
+    auto test = Build(exit[0]);
+    auto results = BuildBody(exit, 1);
+    if (results.empty()) {
+        results.push_back(heap->Make<ConstantNode>(Unspecified()));
+    }
+    auto commands = BuildBody(arguments, 2);
+    commands.push_back(heap->Make<RecurNode>(std::move(steps)));
+    auto body = heap->Make<IfNode>(test, sequence(std::move(results)),
+                                   sequence(std::move(commands)));
+    return heap->Make<LetNode>(NodeKind::Loop, std::move(names), std::move(values),
+                               std::vector<Node*>{body});
+}
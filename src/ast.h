@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "object.h"
+#include "symbols.h"
+
+// Code is checked and lowered to nodes once, before any evaluator runs it.
+// Special forms become dedicated nodes, so they are keywords and not values.
+enum class NodeKind : uint8_t {
+    Constant,
+    Variable,
+    If,
+    Define,
+    Set,
+    Lambda,
+    And,
+    Or,
+    Call,
+    Folded,
+    Let,
+    Letrec,
+    Loop,
+    Recur,
+};
+
+struct Node : Object {
+    friend class Heap;
+
+protected:
+    explicit Node(NodeKind kind);
+
+public:
+    const NodeKind kind;
+
+    Object* Copy() const override;
+    std::string ToString() const override;
+    void Trace(std::vector<Object*>* edges) const override;
+};
+
+struct ConstantNode : Node {
+    friend class Heap;
+
+private:
+    explicit ConstantNode(Object* value);
+
+public:
+    Object* const value;
+};
+
+struct VariableNode : Node {
+    friend class Heap;
+
+private:
+    explicit VariableNode(SymbolId name);
+
+public:
+    const SymbolId name;
+
+    // Global binding of the name, remembered by the tree walking evaluator.
+    Binding* GetCachedBinding(Scope* globals) const;
+    void CacheBinding(Scope* globals, Binding* binding);
+
+private:
+    Scope* cached_globals_ = nullptr;
+    Binding* cached_binding_ = nullptr;
+};
+
+struct IfNode : Node {
+    friend class Heap;
+
+private:
+    IfNode(Node* condition, Node* consequent, Node* alternative);
+
+public:
+    Node* const condition;
+    Node* const consequent;
+    // nullptr when there is no else branch
+    Node* const alternative;
+};
+
+// Both define and set! of a variable.
+struct AssignNode : Node {
+    friend class Heap;
+
+private:
+    AssignNode(NodeKind kind, SymbolId name, Node* value);
+
+public:
+    const SymbolId name;
+    Node* const value;
+};
+
+// What the code of a lambda tells about its side effects, see LambdaNode.
+struct LambdaEffects {
+    bool mutates_outer_state = false;
+    std::vector<SymbolId> free_names;
+};
+
+struct LambdaNode : Node {
+    friend class Heap;
+
+private:
+    LambdaNode(std::vector<SymbolId> arguments, std::vector<Node*> body);
+    LambdaNode(std::vector<SymbolId> arguments, std::vector<Node*> body, LambdaEffects effects);
+
+public:
+    const std::vector<SymbolId> arguments;
+    // never empty
+    const std::vector<Node*> body;
+    // Only lambdas created in the body could capture the scope of a call.
+    const bool creates_lambdas;
+    // set! of a name the lambda does not bind, a call or any other use of set-car!, set-cdr!,
+    // vector-set! or vector-fill!, or a call of a function that is unknown from the code:
+    // an argument or a computed value
+    const bool mutates_outer_state;
+    // names the lambda and the nested ones read from the enclosing scopes, the functions
+    // bound to them decide whether a call could have side effects
+    const std::vector<SymbolId> free_names;
+};
+
+// let and letrec bind the names in a new scope, let* is lowered to nested lets.
+// The values of let are evaluated outside of the scope, the values of letrec inside of it.
+// A loop is a let, that is run again by the recur nodes in the tail positions of its body.
+struct LetNode : Node {
+    friend class Heap;
+
+private:
+    LetNode(NodeKind kind, std::vector<SymbolId> names, std::vector<Node*> values,
+            std::vector<Node*> body);
+
+public:
+    const std::vector<SymbolId> names;
+    const std::vector<Node*> values;
+    // never empty
+    const std::vector<Node*> body;
+    // names followed by the names defined in the scope
+    const std::vector<SymbolId> scope_names;
+    const bool creates_lambdas;
+};
+
+// Tail call of a named let or the next iteration of do: binds the names of the innermost
+// enclosing loop of the same lambda to the values of the arguments.
+struct RecurNode : Node {
+    friend class Heap;
+
+private:
+    explicit RecurNode(std::vector<Node*> arguments);
+
+public:
+    const std::vector<Node*> arguments;
+};
+
+// Both and and or, always with at least one operand.
+struct LogicalNode : Node {
+    friend class Heap;
+
+private:
+    LogicalNode(NodeKind kind, std::vector<Node*> operands);
+
+public:
+    const std::vector<Node*> operands;
+};
+
+// A call site of the tree walking evaluator specializes itself on the callee it saw first.
+// Later calls check it is the same callee; once a guard fails, the site stays generic.
+enum class CallState : uint8_t {
+    Uninitialized,
+    Lambda,
+    Builtin,
+    // builtin numeric operation or comparison of two arguments, computed directly
+    // when both arguments are fixnums
+    FixnumOperation,
+    FixnumComparison,
+    Generic,
+};
+
+struct CallNode : Node {
+    friend class Heap;
+
+private:
+    CallNode(Node* callee, std::vector<Node*> arguments, bool improper);
+
+public:
+    Node* const callee;
+    const std::vector<Node*> arguments;
+    // call with an improper argument list, it fails after the callee is evaluated
+    const bool improper;
+
+    CallState GetState() const;
+    Object* GetCachedCallee() const;
+    void Specialize(CallState state, Object* callee);
+    void Deoptimize();
+
+    // nullopt on overflow
+    std::optional<Int> (*operation)(Int, Int) = nullptr;
+    bool (*comparison)(Int, Int) = nullptr;
+
+private:
+    CallState state_ = CallState::Uninitialized;
+    Object* cached_callee_ = nullptr;
+};
+
+// Expected value of a global binding.
+struct BindingGuard {
+    Binding* binding;
+    Object* expected;
+};
+
+// Value of a pure expression computed before evaluation. It is used while the builtins
+// the expression called are still bound to their names, otherwise original is evaluated.
+struct FoldedNode : Node {
+    friend class Heap;
+
+private:
+    FoldedNode(Object* value, Node* original, std::vector<BindingGuard> guards);
+
+public:
+    Object* const value;
+    Node* const original;
+    const std::vector<BindingGuard> guards;
+
+    bool Holds() const;
+};
+
+// Subexpressions of the node in evaluation order.
+std::vector<Node*> GetChildren(Node* node);
+// Names defined in the body, not counting nested lambdas and bodies of nested lets.
+std::vector<SymbolId> GetInternalDefines(const std::vector<Node*>& body);
+
+class AstBuilder {
+public:
+    using Forms = std::vector<Object*>;
+
+    Node* Build(Object* form);
+
+private:
+    Node* BuildSpecialForm(const std::string& name, Object* arguments);
+    std::vector<Node*> BuildBody(const Forms& forms, size_t from);
+
+    Node* BuildQuote(const Forms& arguments);
+    Node* BuildIf(const Forms& arguments);
+    Node* BuildDefine(const Forms& arguments);
+    Node* BuildDefineMemoized(const Forms& arguments);
+    Node* BuildSet(const Forms& arguments);
+    Node* BuildLambda(const Forms& params, size_t from, const Forms& forms);
+    Node* BuildLogical(NodeKind kind, const Forms& arguments);
+    Node* BuildLet(const std::string& name, const Forms& arguments);
+    Node* BuildNamedLet(const Forms& arguments);
+    Node* BuildDo(const Forms& arguments);
+
+    // ((name value) ...) of let, or ((name value [step]) ...) of do
+    struct Bindings {
+        std::vector<SymbolId> names;
+        std::vector<Node*> values;
+        std::vector<Node*> steps;
+    };
+    Bindings BuildBindings(const std::string& form, Object* bindings, bool steps);
+};
@@ -0,0 +1,365 @@
+#include "bignum.h"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+#include <span>
+#include <utility>
+
+namespace {
+
+using Limbs = std::vector<uint32_t>;
+using LimbSpan = std::span<const uint32_t>;
+
+constexpr uint64_t kBase = uint64_t{1} << 32;
+// Karatsuba multiplication is used when the shorter operand has at least this many limbs,
+// below it the schoolbook one is faster.
+constexpr size_t kKaratsubaThreshold = 32;
+// ToString and FromDecimal work with 9 decimal digits at a time.
+constexpr uint32_t kDecimalBase = 1000000000;
+constexpr size_t kDecimalDigits = 9;
+
+void Trim(Limbs* limbs) {
+    while (!limbs->empty() && limbs->back() == 0) {
+        limbs->pop_back();
+    }
+}
+
+LimbSpan Trimmed(LimbSpan limbs) {
+    while (!limbs.empty() && limbs.back() == 0) {
+        limbs = limbs.first(limbs.size() - 1);
+    }
+    return limbs;
+}
+
+int CompareMagnitudes(LimbSpan lhs, LimbSpan rhs) {
+    if (lhs.size() != rhs.size()) {
+        return lhs.size() < rhs.size() ? -1 : 1;
+    }
+    for (size_t i = lhs.size(); i-- > 0;) {
+        if (lhs[i] != rhs[i]) {
+            return lhs[i] < rhs[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// *target += value * 2^(32 * offset)
+void AddTo(Limbs* target, LimbSpan value, size_t offset) {
+    auto& limbs = *target;
+    if (limbs.size() < offset + value.size()) {
+        limbs.resize(offset + value.size());
+    }
+    uint64_t carry = 0;
+    size_t i = offset;
+    for (auto limb : value) {
+        carry += uint64_t{limbs[i]} + limb;
+        limbs[i++] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    for (; carry != 0; ++i) {
+        if (i == limbs.size()) {
+            limbs.push_back(0);
+        }
+        carry += limbs[i];
+        limbs[i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+}
+
+// *target -= value, the target must not be less than the value
+void SubtractFrom(Limbs* target, LimbSpan value) {
+    auto& limbs = *target;
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < limbs.size() && (i < value.size() || borrow != 0); ++i) {
+        uint64_t subtrahend = (i < value.size() ? value[i] : 0) + borrow;
+        borrow = limbs[i] < subtrahend;
+        limbs[i] = static_cast<uint32_t>(limbs[i] - subtrahend);
+    }
+    Trim(target);
+}
+
+// *target = *target * factor + addend
+void MultiplyAdd(Limbs* target, uint32_t factor, uint32_t addend) {
+    uint64_t carry = addend;
+    for (auto& limb : *target) {
+        carry += uint64_t{limb} * factor;
+        limb = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    if (carry != 0) {
+        target->push_back(static_cast<uint32_t>(carry));
+    }
+}
+
+// *target /= divisor, returns the remainder
+uint32_t DivideInPlace(Limbs* target, uint32_t divisor) {
+    uint64_t remainder = 0;
+    for (size_t i = target->size(); i-- > 0;) {
+        uint64_t current = (remainder << 32) | (*target)[i];
+        (*target)[i] = static_cast<uint32_t>(current / divisor);
+        remainder = current % divisor;
+    }
+    Trim(target);
+    return static_cast<uint32_t>(remainder);
+}
+
+Limbs MultiplySchoolbook(LimbSpan lhs, LimbSpan rhs) {
+    Limbs result(lhs.size() + rhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < rhs.size(); ++j) {
+            // (2^32 - 1)^2 + 2 (2^32 - 1) still fits into 64 bits
+            carry += uint64_t{lhs[i]} * rhs[j] + result[i + j];
+            result[i + j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        result[i + rhs.size()] = static_cast<uint32_t>(carry);
+    }
+    Trim(&result);
+    return result;
+}
+
+// Karatsuba: with lhs = a1 B^k + a0 and rhs = b1 B^k + b0 the product is
+// a1 b1 B^2k + ((a0 + a1) (b0 + b1) - a1 b1 - a0 b0) B^k + a0 b0, three products of halves.
+Limbs MultiplyMagnitudes(LimbSpan lhs, LimbSpan rhs) {
+    lhs = Trimmed(lhs);
+    rhs = Trimmed(rhs);
+    if (lhs.size() < rhs.size()) {
+        std::swap(lhs, rhs);
+    }
+    if (rhs.size() < kKaratsubaThreshold) {
+        return MultiplySchoolbook(lhs, rhs);
+    }
+    if (2 * rhs.size() <= lhs.size()) {
+        // the halves of lhs would be longer than rhs, so it is multiplied by slices instead
+        Limbs result;
+        for (size_t from = 0; from < lhs.size(); from += rhs.size()) {
+            auto slice = lhs.subspan(from, std::min(rhs.size(), lhs.size() - from));
+            AddTo(&result, MultiplyMagnitudes(slice, rhs), from);
+        }
+        Trim(&result);
+        return result;
+    }
+    auto k = lhs.size() / 2;
+    auto a0 = lhs.first(k);
+    auto a1 = lhs.subspan(k);
+    auto b0 = rhs.first(k);
+    auto b1 = rhs.subspan(k);
+    auto low = MultiplyMagnitudes(a0, b0);
+    auto high = MultiplyMagnitudes(a1, b1);
+    Limbs a_sum(a0.begin(), a0.end());
+    AddTo(&a_sum, a1, 0);
+    Limbs b_sum(b0.begin(), b0.end());
+    AddTo(&b_sum, b1, 0);
+    auto middle = MultiplyMagnitudes(a_sum, b_sum);
+    SubtractFrom(&middle, low);
+    SubtractFrom(&middle, high);
+    auto result = std::move(low);
+    AddTo(&result, middle, k);
+    AddTo(&result, high, 2 * k);
+    Trim(&result);
+    return result;
+}
+
+// The value shifted left by less than 32 bits, in size limbs.
+Limbs ShiftLeft(LimbSpan limbs, int shift, size_t size) {
+    Limbs result(size);
+    for (size_t i = 0; i < limbs.size(); ++i) {
+        uint64_t shifted = uint64_t{limbs[i]} << shift;
+        result[i] |= static_cast<uint32_t>(shifted);
+        if (i + 1 < size) {
+            result[i + 1] |= static_cast<uint32_t>(shifted >> 32);
+        }
+    }
+    return result;
+}
+
+// Knuth's algorithm D. The divisor is shifted so its top limb has the high bit set, then
+// the quotient limb estimated from the top limbs is at most two too large.
+Limbs DivideMagnitudes(LimbSpan dividend, LimbSpan divisor) {
+    if (CompareMagnitudes(dividend, divisor) < 0) {
+        return {};
+    }
+    if (divisor.size() == 1) {
+        Limbs quotient(dividend.begin(), dividend.end());
+        DivideInPlace(&quotient, divisor[0]);
+        return quotient;
+    }
+    auto n = divisor.size();
+    auto m = dividend.size() - n;
+    auto shift = std::countl_zero(divisor.back());
+    auto v = ShiftLeft(divisor, shift, n);
+    auto u = ShiftLeft(dividend, shift, dividend.size() + 1);
+    Limbs quotient(m + 1);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t numerator = (uint64_t{u[j + n]} << 32) | u[j + n - 1];
+        uint64_t estimate = numerator / v[n - 1];
+        uint64_t remainder = numerator % v[n - 1];
+        while (estimate >= kBase || estimate * v[n - 2] > ((remainder << 32) | u[j + n - 2])) {
+            --estimate;
+            remainder += v[n - 1];
+            if (remainder >= kBase) {
+                break;
+            }
+        }
+        int64_t borrow = 0;
+        int64_t difference = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t product = estimate * v[i];
+            difference = int64_t{u[i + j]} - borrow - static_cast<int64_t>(product & 0xffffffff);
+            u[i + j] = static_cast<uint32_t>(difference);
+            borrow = static_cast<int64_t>(product >> 32) - (difference >> 32);
+        }
+        difference = int64_t{u[j + n]} - borrow;
+        u[j + n] = static_cast<uint32_t>(difference);
+        if (difference < 0) {
+            // the estimate was one too large, the divisor is added back
+            --estimate;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; ++i) {
+                carry += uint64_t{u[i + j]} + v[i];
+                u[i + j] = static_cast<uint32_t>(carry);
+                carry >>= 32;
+            }
+            u[j + n] += static_cast<uint32_t>(carry);
+        }
+        quotient[j] = static_cast<uint32_t>(estimate);
+    }
+    Trim(&quotient);
+    return quotient;
+}
+
+}  // namespace
+
+BigInt::BigInt(Int value) : negative_(value < 0) {
+    // the negation is done on the unsigned value, so it works for kIntMin too
+    auto magnitude = negative_ ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    magnitude_ = {static_cast<uint32_t>(magnitude), static_cast<uint32_t>(magnitude >> 32)};
+    Trim(&magnitude_);
+}
+
+BigInt::BigInt(bool negative, Limbs magnitude) : magnitude_(std::move(magnitude)) {
+    Trim(&magnitude_);
+    negative_ = negative && !magnitude_.empty();
+}
+
+BigInt BigInt::FromDecimal(std::string_view digits, bool negative) {
+    Limbs magnitude;
+    auto chunk = digits.size() % kDecimalDigits;
+    if (chunk == 0) {
+        chunk = kDecimalDigits;
+    }
+    for (size_t from = 0; from < digits.size(); from += chunk, chunk = kDecimalDigits) {
+        uint32_t value = 0;
+        uint32_t factor = 1;
+        for (auto digit : digits.substr(from, chunk)) {
+            value = value * 10 + (digit - '0');
+            factor *= 10;
+        }
+        MultiplyAdd(&magnitude, factor, value);
+    }
+    return BigInt(negative, std::move(magnitude));
+}
+
+bool BigInt::IsZero() const {
+    return magnitude_.empty();
+}
+
+bool BigInt::IsNegative() const {
+    return negative_;
+}
+
+std::optional<Int> BigInt::ToInt() const {
+    if (magnitude_.size() > 2) {
+        return std::nullopt;
+    }
+    uint64_t magnitude = 0;
+    for (size_t i = magnitude_.size(); i-- > 0;) {
+        magnitude = (magnitude << 32) | magnitude_[i];
+    }
+    if (!negative_ && magnitude <= static_cast<uint64_t>(kIntMax)) {
+        return static_cast<Int>(magnitude);
+    }
+    if (negative_ && magnitude <= static_cast<uint64_t>(kIntMax) + 1) {
+        return static_cast<Int>(0 - magnitude);
+    }
+    return std::nullopt;
+}
+
+std::string BigInt::ToString() const {
+    if (IsZero()) {
+        return "0";
+    }
+    auto magnitude = magnitude_;
+    std::vector<uint32_t> chunks;
+    while (!magnitude.empty()) {
+        chunks.push_back(DivideInPlace(&magnitude, kDecimalBase));
+    }
+    std::string result = negative_ ? "-" : "";
+    result += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        auto chunk = std::to_string(chunks[i]);
+        result.append(kDecimalDigits - chunk.size(), '0');
+        result += chunk;
+    }
+    return result;
+}
+
+size_t BigInt::Hash() const {
+    size_t hash = negative_;
+    for (auto limb : magnitude_) {
+        hash = hash * 1000003 ^ std::hash<uint32_t>()(limb);
+    }
+    return hash;
+}
+
+BigInt BigInt::operator-() const {
+    return BigInt(!negative_, magnitude_);
+}
+
+BigInt BigInt::Abs() const {
+    return BigInt(false, magnitude_);
+}
+
+BigInt operator+(const BigInt& lhs, const BigInt& rhs) {
+    if (lhs.negative_ == rhs.negative_) {
+        auto magnitude = lhs.magnitude_;
+        AddTo(&magnitude, rhs.magnitude_, 0);
+        return BigInt(lhs.negative_, std::move(magnitude));
+    }
+    // the sign of the result is the sign of the operand with the larger magnitude
+    if (CompareMagnitudes(lhs.magnitude_, rhs.magnitude_) >= 0) {
+        auto magnitude = lhs.magnitude_;
+        SubtractFrom(&magnitude, rhs.magnitude_);
+        return BigInt(lhs.negative_, std::move(magnitude));
+    }
+    auto magnitude = rhs.magnitude_;
+    SubtractFrom(&magnitude, lhs.magnitude_);
+    return BigInt(rhs.negative_, std::move(magnitude));
+}
+
+BigInt operator-(const BigInt& lhs, const BigInt& rhs) {
+    return lhs + -rhs;
+}
+
+BigInt operator*(const BigInt& lhs, const BigInt& rhs) {
+    return BigInt(lhs.negative_ != rhs.negative_,
+                  MultiplyMagnitudes(lhs.magnitude_, rhs.magnitude_));
+}
+
+BigInt operator/(const BigInt& lhs, const BigInt& rhs) {
+    return BigInt(lhs.negative_ != rhs.negative_,
+                  DivideMagnitudes(lhs.magnitude_, rhs.magnitude_));
+}
+
+std::strong_ordering operator<=>(const BigInt& lhs, const BigInt& rhs) {
+    if (lhs.negative_ != rhs.negative_) {
+        return lhs.negative_ ? std::strong_ordering::less : std::strong_ordering::greater;
+    }
+    auto order = CompareMagnitudes(lhs.magnitude_, rhs.magnitude_);
+    if (lhs.negative_) {
+        order = -order;
+    }
+    return order <=> 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "int_type.h"
+
+// Integer of any size: a sign and the magnitude in base 2^32 limbs, the least significant
+// first. The magnitude has no leading zero limbs, so zero has no limbs and is not negative.
+class BigInt {
+public:
+    BigInt() = default;
+    explicit BigInt(Int value);
+
+    // digits is a nonempty string of decimal digits without a sign
+    static BigInt FromDecimal(std::string_view digits, bool negative);
+
+    bool IsZero() const;
+    bool IsNegative() const;
+    // nullopt if the value does not fit into Int
+    std::optional<Int> ToInt() const;
+    std::string ToString() const;
+    size_t Hash() const;
+
+    BigInt operator-() const;
+    BigInt Abs() const;
+
+    friend BigInt operator+(const BigInt& lhs, const BigInt& rhs);
+    friend BigInt operator-(const BigInt& lhs, const BigInt& rhs);
+    friend BigInt operator*(const BigInt& lhs, const BigInt& rhs);
+    // Truncates towards zero like the division of Int, rhs must not be zero.
+    friend BigInt operator/(const BigInt& lhs, const BigInt& rhs);
+
+    friend bool operator==(const BigInt& lhs, const BigInt& rhs) = default;
+    friend std::strong_ordering operator<=>(const BigInt& lhs, const BigInt& rhs);
+
+private:
+    using Limbs = std::vector<uint32_t>;
+
+    BigInt(bool negative, Limbs magnitude);
+
+    bool negative_ = false;
+    Limbs magnitude_;
+};
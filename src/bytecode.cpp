@@ -0,0 +1,81 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+Prototype::Prototype() : Object(ObjectType::Prototype) {
+}
+Prototype::~Prototype() = default;
+Object* Prototype::Copy() const {
+    throw std::runtime_error("prototype is not copyable");
+}
+std::string Prototype::ToString() const {
+    return "<prototype '" + name + "'>";
+}
+void Prototype::Trace(std::vector<Object*>* edges) const {
+    edges->insert(edges->end(), constants_.begin(), constants_.end());
+}
+size_t Prototype::AddConstant(Object* constant) {
+    constants_.push_back(constant);
+    return constants_.size() - 1;
+}
+size_t Prototype::AddBinding(Binding* binding) {
+    auto it = std::find(bindings.begin(), bindings.end(), binding);
+    if (it != bindings.end()) {
+        return it - bindings.begin();
+    }
+    bindings.push_back(binding);
+    return bindings.size() - 1;
+}
+const std::vector<Object*>& Prototype::GetConstants() const {
+    return constants_;
+}
+
+Box::Box(Object* value) : Object(ObjectType::Box), value_(value) {
+}
+Object* Box::Copy() const {
+    throw std::runtime_error("box is not copyable");
+}
+std::string Box::ToString() const {
+    return "<box>";
+}
+Object* Box::Get() const {
+    return value_;
+}
+void Box::Set(Object* value) {
+    value_ = value;
+}
+void Box::Trace(std::vector<Object*>* edges) const {
+    edges->push_back(value_);
+}
+
+Closure::Closure(Prototype* prototype, std::vector<Object*> captures)
+    : Object(ObjectType::Closure), prototype_(prototype), captures_(std::move(captures)) {
+}
+void Closure::Trace(std::vector<Object*>* edges) const {
+    edges->push_back(prototype_);
+    edges->insert(edges->end(), captures_.begin(), captures_.end());
+}
+Object* Closure::Copy() const {
+    static auto heap = GetHeap();
+    return heap->Make<Closure>(prototype_, captures_);
+}
+std::string Closure::ToString() const {
+    std::string ans = "<lambda '" + prototype_->name + "' with args:";
+    for (size_t i = 0; i < prototype_->arguments.size(); ++i) {
+        ans += " '" + GetSymbolName(prototype_->arguments[i]) + "'";
+    }
+    ans += ">";
+    return ans;
+}
+Prototype* Closure::GetPrototype() const {
+    return prototype_;
+}
+Object* Closure::GetCapture(size_t index) const {
+    return captures_[index];
+}
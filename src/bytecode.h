@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jit.h"
+#include "object.h"
+#include "symbols.h"
+
+// Locals live on the VM stack right above the callee, slot arg of the current call.
+// Captures are values copied into the closure when it is created; a variable that is both
+// captured and assigned (or defined in the body) is shared through a Box instead.
+enum class OpCode : uint8_t {
+    Constant,          // push constants[arg]
+    Nil,               // push empty list
+    Folded,            // push value of the folded constants[arg] if it holds, else skip next
+    LoadLocal,         // push local, that is always bound (lambda argument)
+    LoadLocalChecked,  // push local, that could be read before its define
+    LoadBoxed,         // push value of boxed local
+    DefineLocal,       // define local with top of the stack
+    DefineBoxed,       // define boxed local with top of the stack
+    StoreLocal,        // pop value into local, binding of let
+    ClearLocal,        // unbind local, a boxed one gets a new box
+    SetLocal,          // set bound local to top of the stack
+    SetBoxed,          // set bound boxed local to top of the stack
+    LoadCapture,       // push captures[arg] of the current closure
+    LoadCaptureBoxed,  // push value of the boxed captures[arg]
+    SetCaptureBoxed,   // set bound boxed captures[arg] to top of the stack
+    LoadGlobal,        // push value of bindings[arg]
+    DefineGlobal,      // define bindings[arg] with top of the stack
+    SetGlobal,         // set bound bindings[arg] to top of the stack
+    Pop,               // drop top of the stack
+    Jump,              // pc = arg, forward
+    Loop,              // pc = arg, backward to the head of a loop
+    JumpIfFalse,       // pop value, pc = arg if it is false
+    JumpIfFalseOr,     // if top is false pc = arg, otherwise pop it
+    JumpIfTrueOr,      // if top is true pc = arg, otherwise pop it
+    MakeClosure,       // push closure over constants[arg], filling its captures
+    Call,              // call stack[-arg - 1] with arg values above it
+    TailCall,          // same as Call, but the callee reuses the frame of the caller
+    ImproperCall,      // fail on call with improper argument list
+    Return,            // return top of the stack
+};
+
+struct Instruction {
+    OpCode code;
+    uint32_t arg;
+};
+
+// Where a closure takes a captured variable from, when it is created:
+// local slot index of the enclosing lambda or captures[index] of the enclosing closure.
+struct Capture {
+    bool local;
+    uint32_t index;
+    SymbolId name;
+};
+
+struct Prototype : Object {
+    friend class Heap;
+
+private:
+    Prototype();
+
+public:
+    ~Prototype() override;
+
+    std::vector<SymbolId> arguments;
+    // arguments followed by internal defines and names bound by let, one stack slot each
+    std::vector<SymbolId> locals;
+    // locals that are kept in a Box
+    std::vector<bool> boxed;
+    std::vector<Capture> captures;
+    // global cells used by the code, loaded without any lookup
+    std::vector<Binding*> bindings;
+    std::string name;
+    std::vector<Instruction> code;
+    // see LambdaNode
+    bool mutates_outer_state = false;
+    std::vector<SymbolId> free_names;
+    // calls of closures over the prototype and iterations of its loops,
+    // native code is compiled once they are many
+    size_t call_count = 0;
+    std::unique_ptr<NativeCode> native;
+
+    Object* Copy() const override;
+    std::string ToString() const override;
+    void Trace(std::vector<Object*>* edges) const override;
+
+    size_t AddConstant(Object* constant);
+    size_t AddBinding(Binding* binding);
+    const std::vector<Object*>& GetConstants() const;
+
+private:
+    std::vector<Object*> constants_;
+};
+
+template <>
+struct TypeRange<Prototype> : TypeRangeOf<ObjectType::Prototype> {};
+
+// Variable shared between a frame and the closures capturing it.
+struct Box : Object {
+    friend class Heap;
+
+private:
+    explicit Box(Object* value);
+
+public:
+    Object* Copy() const override;
+    std::string ToString() const override;
+    void Trace(std::vector<Object*>* edges) const override;
+
+    Object* Get() const;
+    void Set(Object* value);
+
+private:
+    Object* value_;
+};
+
+template <>
+struct TypeRange<Box> : TypeRangeOf<ObjectType::Box> {};
+
+struct Closure : Object {
+    friend class Heap;
+
+private:
+    Closure(Prototype* prototype, std::vector<Object*> captures);
+
+public:
+    Object* Copy() const override;
+    std::string ToString() const override;
+    void Trace(std::vector<Object*>* edges) const override;
+
+    Prototype* GetPrototype() const;
+    Object* GetCapture(size_t index) const;
+
+private:
+    Prototype* prototype_;
+    std::vector<Object*> captures_;
+};
+
+template <>
+struct TypeRange<Closure> : TypeRangeOf<ObjectType::Closure> {};
@@ -0,0 +1,402 @@
+#include "compiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "heap.h"
+
+static auto heap = GetHeap();
+
+BytecodeCompiler::BytecodeCompiler(Scope* globals) : globals_(globals) {
+}
+
+using Names = std::set<SymbolId>;
+
+// Finds names, that are referenced from nested lambdas, and names, that are assigned.
+// Shadowing is ignored, so the result could only be wider than the exact one.
+static void ScanUsage(Node* node, bool nested, Names* captured, Names* assigned) {
+    switch (node->kind) {
+        case NodeKind::Variable:
+            if (nested) {
+                captured->insert(static_cast<VariableNode*>(node)->name);
+            }
+            break;
+        case NodeKind::Define:
+        case NodeKind::Set: {
+            auto name = static_cast<AssignNode*>(node)->name;
+            assigned->insert(name);
+            if (nested) {
+                captured->insert(name);
+            }
+            break;
+        }
+        case NodeKind::Lambda:
+            nested = true;
+            break;
+        default:
+            break;
+    }
+    for (auto child : GetChildren(node)) {
+        ScanUsage(child, nested, captured, assigned);
+    }
+}
+
+Prototype* BytecodeCompiler::CompileTopLevel(Node* node) {
+    auto prototype = heap->Make<Prototype>();
+    prototype->name = "top_level";
+    current_ = prototype;
+    lexical_.push_back({.prototype = prototype});
+    ScanUsage(node, false, &lexical_.back().captured, &lexical_.back().assigned);
+    CompileExpression(node, true);
+    Emit(OpCode::Return);
+    lexical_.pop_back();
+    return prototype;
+}
+
+void BytecodeCompiler::CompileExpression(Node* node, bool tail) {
+    switch (node->kind) {
+        case NodeKind::Constant: {
+            auto value = static_cast<ConstantNode*>(node)->value;
+            if (value == nullptr) {
+                Emit(OpCode::Nil);
+            } else {
+                Emit(OpCode::Constant, current_->AddConstant(value));
+            }
+            break;
+        }
+        case NodeKind::Variable:
+            EmitLoad(static_cast<VariableNode*>(node)->name);
+            break;
+        case NodeKind::If:
+            CompileIf(static_cast<IfNode*>(node), tail);
+            break;
+        case NodeKind::Define: {
+            auto define = static_cast<AssignNode*>(node);
+            CompileExpression(define->value);
+            EmitDefine(define->name);
+            break;
+        }
+        case NodeKind::Set: {
+            auto set = static_cast<AssignNode*>(node);
+            CompileExpression(set->value);
+            EmitSet(set->name);
+            break;
+        }
+        case NodeKind::Lambda:
+            CompileLambda(static_cast<LambdaNode*>(node));
+            break;
+        case NodeKind::And:
+        case NodeKind::Or:
+            CompileLogical(static_cast<LogicalNode*>(node), tail);
+            break;
+        case NodeKind::Call:
+            CompileCall(static_cast<CallNode*>(node), tail);
+            break;
+        case NodeKind::Folded:
+            CompileFolded(static_cast<FoldedNode*>(node), tail);
+            break;
+        case NodeKind::Let:
+        case NodeKind::Letrec:
+        case NodeKind::Loop:
+            CompileLet(static_cast<LetNode*>(node), tail);
+            break;
+        case NodeKind::Recur:
+            CompileRecur(static_cast<RecurNode*>(node));
+            break;
+    }
+}
+
+void BytecodeCompiler::CompileBody(const std::vector<Node*>& body, bool tail) {
+    for (size_t i = 0; i < body.size(); ++i) {
+        if (i != 0) {
+            Emit(OpCode::Pop);
+        }
+        CompileExpression(body[i], tail && i + 1 == body.size());
+    }
+}
+
+void BytecodeCompiler::CompileCall(CallNode* call, bool tail) {
+    CompileExpression(call->callee);
+    if (call->improper) {
+        Emit(OpCode::ImproperCall);
+        return;
+    }
+    for (auto argument : call->arguments) {
+        CompileExpression(argument);
+    }
+    Emit(tail ? OpCode::TailCall : OpCode::Call, call->arguments.size());
+}
+
+void BytecodeCompiler::CompileFolded(FoldedNode* node, bool tail) {
+    Emit(OpCode::Folded, current_->AddConstant(node));
+    auto to_end = Emit(OpCode::Jump);
+    CompileExpression(node->original, tail);
+    PatchJump(to_end);
+}
+
+void BytecodeCompiler::CompileIf(IfNode* node, bool tail) {
+    CompileExpression(node->condition);
+    auto to_else = Emit(OpCode::JumpIfFalse);
+    CompileExpression(node->consequent, tail);
+    auto to_end = Emit(OpCode::Jump);
+    PatchJump(to_else);
+    if (node->alternative != nullptr) {
+        CompileExpression(node->alternative, tail);
+    } else {
+        Emit(OpCode::Nil);
+    }
+    PatchJump(to_end);
+}
+
+// A captured local is copied into closures, unless it could change after the closure is made:
+// then frame and closures share it through a box. Internal defines are boxed for the closures
+// created before the define, e.g. mutually recursive functions.
+void BytecodeCompiler::CompileLambda(LambdaNode* node) {
+    auto prototype = heap->Make<Prototype>();
+    prototype->name = "lambda_" + std::to_string(Lambda::free_index++);
+    prototype->arguments = node->arguments;
+    prototype->mutates_outer_state = node->mutates_outer_state;
+    prototype->free_names = node->free_names;
+
+    auto enclosing = current_;
+    current_ = prototype;
+    lexical_.push_back({.prototype = prototype});
+    auto& level = lexical_.back();
+    for (auto body : node->body) {
+        ScanUsage(body, false, &level.captured, &level.assigned);
+    }
+    for (auto argument : node->arguments) {
+        AddLocal(argument, false,
+                 level.captured.contains(argument) && level.assigned.contains(argument));
+    }
+    // internal defines get their frame slots before the body is compiled,
+    // so references preceding the define resolve to the same slot
+    for (auto local : GetInternalDefines(node->body)) {
+        if (std::find(node->arguments.begin(), node->arguments.end(), local) ==
+            node->arguments.end()) {
+            AddLocal(local, true, level.captured.contains(local));
+        }
+    }
+    CompileBody(node->body);
+    Emit(OpCode::Return);
+    lexical_.pop_back();
+    current_ = enclosing;
+
+    Emit(OpCode::MakeClosure, current_->AddConstant(prototype));
+}
+
+// Names of a let get new slots of the current frame, they are visible only in its body.
+// Values of let are stored after all of them are computed, values of letrec one by one.
+// A loop is a let with its head after the stores: recur nodes store the new values and jump
+// back there. Slots bound in a loop are cleared each time, so every iteration has its own
+// boxes and its defines start unbound.
+void BytecodeCompiler::CompileLet(LetNode* node, bool tail) {
+    const auto& names = node->scope_names;
+    auto visible = lexical_.back().locals.size();
+    auto add_names = [this, &names](size_t from, size_t to, bool checked) {
+        std::vector<uint32_t> slots;
+        for (size_t i = from; i < to; ++i) {
+            auto& level = lexical_.back();
+            bool captured = level.captured.contains(names[i]);
+            bool boxed = checked ? captured : captured && level.assigned.contains(names[i]);
+            slots.push_back(AddLocal(names[i], checked, boxed));
+            if (checked && !level.loops.empty()) {
+                Emit(OpCode::ClearLocal, slots.back());
+            }
+        }
+        return slots;
+    };
+    if (node->kind == NodeKind::Letrec) {
+        auto slots = add_names(0, names.size(), true);
+        for (size_t i = 0; i < node->values.size(); ++i) {
+            CompileExpression(node->values[i]);
+            EmitStore(slots[i], false);
+        }
+        CompileBody(node->body, tail);
+    } else {
+        for (auto value : node->values) {
+            CompileExpression(value);
+        }
+        auto slots = add_names(0, node->names.size(), false);
+        for (size_t i = slots.size(); i-- > 0;) {
+            EmitStore(slots[i], !lexical_.back().loops.empty());
+        }
+        if (node->kind == NodeKind::Loop) {
+            lexical_.back().loops.push_back({current_->code.size(), slots});
+        }
+        add_names(node->names.size(), names.size(), true);
+        CompileBody(node->body, tail);
+        if (node->kind == NodeKind::Loop) {
+            lexical_.back().loops.pop_back();
+        }
+    }
+    lexical_.back().locals.resize(visible);
+}
+
+void BytecodeCompiler::CompileRecur(RecurNode* node) {
+    auto loop = lexical_.back().loops.back();
+    for (auto argument : node->arguments) {
+        CompileExpression(argument);
+    }
+    for (size_t i = loop.slots.size(); i-- > 0;) {
+        EmitStore(loop.slots[i], true);
+    }
+    Emit(OpCode::Loop, loop.pc);
+}
+
+// and leaves the first false value, or returns the last one; or is symmetric
+void BytecodeCompiler::CompileLogical(LogicalNode* node, bool tail) {
+    auto branch = node->kind == NodeKind::And ? OpCode::JumpIfFalseOr : OpCode::JumpIfTrueOr;
+    auto& operands = node->operands;
+    std::vector<size_t> to_end;
+    for (size_t i = 0; i < operands.size(); ++i) {
+        CompileExpression(operands[i], tail && i + 1 == operands.size());
+        if (i + 1 != operands.size()) {
+            to_end.push_back(Emit(branch));
+        }
+    }
+    for (auto jump : to_end) {
+        PatchJump(jump);
+    }
+}
+
+BytecodeCompiler::Address BytecodeCompiler::Resolve(SymbolId name) {
+    if (auto address = ResolveIn(lexical_.size(), name)) {
+        return *address;
+    }
+    return {
+        .kind = Address::Global,
+        .checked = true,
+        .boxed = false,
+        .slot = static_cast<uint32_t>(current_->AddBinding(globals_->GetBinding(name))),
+    };
+}
+
+// Looks the name up in lexical_[level - 1] and then in the enclosing levels.
+// A variable of an enclosing lambda is added to the captures of every lambda in between.
+std::optional<BytecodeCompiler::Address> BytecodeCompiler::ResolveIn(size_t level, SymbolId name) {
+    if (level == 0) {
+        return std::nullopt;
+    }
+    auto prototype = lexical_[level - 1].prototype;
+    auto& locals = lexical_[level - 1].locals;
+    auto it = std::find_if(locals.rbegin(), locals.rend(),
+                           [name](const Local& local) { return local.name == name; });
+    if (it != locals.rend()) {
+        return Address{
+            .kind = Address::Local,
+            .checked = it->checked,
+            .boxed = prototype->boxed[it->slot],
+            .slot = it->slot,
+        };
+    }
+    auto outer = ResolveIn(level - 1, name);
+    if (!outer) {
+        return std::nullopt;
+    }
+    Capture capture{
+        .local = outer->kind == Address::Local,
+        .index = outer->slot,
+        .name = name,
+    };
+    auto& captures = prototype->captures;
+    size_t index = 0;
+    while (index < captures.size() &&
+           (captures[index].local != capture.local || captures[index].index != capture.index)) {
+        ++index;
+    }
+    if (index == captures.size()) {
+        captures.push_back(capture);
+    }
+    return Address{
+        .kind = Address::Captured,
+        .checked = outer->checked,
+        .boxed = outer->boxed,
+        .slot = static_cast<uint32_t>(index),
+    };
+}
+
+void BytecodeCompiler::EmitLoad(SymbolId name) {
+    auto address = Resolve(name);
+    switch (address.kind) {
+        case Address::Global:
+            Emit(OpCode::LoadGlobal, address.slot);
+            break;
+        case Address::Local:
+            if (address.boxed) {
+                Emit(OpCode::LoadBoxed, address.slot);
+            } else if (address.checked) {
+                Emit(OpCode::LoadLocalChecked, address.slot);
+            } else {
+                Emit(OpCode::LoadLocal, address.slot);
+            }
+            break;
+        case Address::Captured:
+            Emit(address.boxed ? OpCode::LoadCaptureBoxed : OpCode::LoadCapture, address.slot);
+            break;
+    }
+}
+
+uint32_t BytecodeCompiler::AddLocal(SymbolId name, bool checked, bool boxed) {
+    auto slot = static_cast<uint32_t>(current_->locals.size());
+    current_->locals.push_back(name);
+    current_->boxed.push_back(boxed);
+    lexical_.back().locals.push_back({name, slot, checked});
+    return slot;
+}
+
+// Defines of the top level, that are not in a let, are global;
+// other defines already have their slots, see CompileLambda and CompileLet.
+void BytecodeCompiler::EmitDefine(SymbolId name) {
+    auto address = Resolve(name);
+    if (address.kind == Address::Global) {
+        Emit(OpCode::DefineGlobal, address.slot);
+        return;
+    }
+    assert(address.kind == Address::Local);
+    Emit(address.boxed ? OpCode::DefineBoxed : OpCode::DefineLocal, address.slot);
+}
+
+void BytecodeCompiler::EmitSet(SymbolId name) {
+    auto address = Resolve(name);
+    switch (address.kind) {
+        case Address::Global:
+            Emit(OpCode::SetGlobal, address.slot);
+            break;
+        case Address::Local:
+            Emit(address.boxed ? OpCode::SetBoxed : OpCode::SetLocal, address.slot);
+            break;
+        case Address::Captured:
+            // assigned captures are always boxed, see CompileLambda and CompileLet
+            assert(address.boxed);
+            Emit(OpCode::SetCaptureBoxed, address.slot);
+            break;
+    }
+}
+
+// Pops the value of a let binding into its slot, a fresh binding gets a new box.
+void BytecodeCompiler::EmitStore(uint32_t slot, bool fresh) {
+    if (current_->boxed[slot]) {
+        if (fresh) {
+            Emit(OpCode::ClearLocal, slot);
+        }
+        Emit(OpCode::DefineBoxed, slot);
+        Emit(OpCode::Pop);
+    } else {
+        Emit(OpCode::StoreLocal, slot);
+    }
+}
+
+size_t BytecodeCompiler::Emit(OpCode code, uint32_t arg) {
+    current_->code.push_back({code, arg});
+    return current_->code.size() - 1;
+}
+
+void BytecodeCompiler::PatchJump(size_t jump) {
+    current_->code[jump].arg = current_->code.size();
+}
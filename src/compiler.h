@@ -0,0 +1,76 @@
+#pragma once
+
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "ast.h"
+#include "bytecode.h"
+#include "object.h"
+#include "symbols.h"
+
+class BytecodeCompiler {
+public:
+    explicit BytecodeCompiler(Scope* globals);
+
+    Prototype* CompileTopLevel(Node* node);
+
+private:
+    struct Address {
+        enum Kind { Global, Local, Captured } kind;
+        // local, that is not an argument, so it could be read before its define
+        bool checked;
+        bool boxed;
+        uint32_t slot;
+    };
+
+    struct Local {
+        SymbolId name;
+        uint32_t slot;
+        bool checked;
+    };
+
+    struct LoopHead {
+        size_t pc;
+        std::vector<uint32_t> slots;
+    };
+
+    // Frame of a lambda or of the top level.
+    struct Level {
+        Prototype* prototype = nullptr;
+        // names in scope, the innermost binding of a name is the last
+        std::vector<Local> locals = {};
+        // names referenced from nested lambdas and names assigned, see ScanUsage
+        std::set<SymbolId> captured = {};
+        std::set<SymbolId> assigned = {};
+        // enclosing loops of the frame, innermost is the last
+        std::vector<LoopHead> loops = {};
+    };
+
+    Address Resolve(SymbolId name);
+    std::optional<Address> ResolveIn(size_t level, SymbolId name);
+    uint32_t AddLocal(SymbolId name, bool checked, bool boxed);
+    void EmitLoad(SymbolId name);
+    void EmitDefine(SymbolId name);
+    void EmitSet(SymbolId name);
+    void EmitStore(uint32_t slot, bool fresh);
+
+    // tail is set when the value of the node is the value of the enclosing lambda
+    void CompileExpression(Node* node, bool tail = false);
+    void CompileBody(const std::vector<Node*>& body, bool tail = true);
+    void CompileCall(CallNode* call, bool tail);
+    void CompileFolded(FoldedNode* node, bool tail);
+    void CompileIf(IfNode* node, bool tail);
+    void CompileLambda(LambdaNode* node);
+    void CompileLet(LetNode* node, bool tail);
+    void CompileRecur(RecurNode* node);
+    void CompileLogical(LogicalNode* node, bool tail);
+
+    size_t Emit(OpCode code, uint32_t arg = 0);
+    void PatchJump(size_t jump);
+
+    Scope* globals_;
+    Prototype* current_ = nullptr;
+    // the top level and the enclosing lambdas, innermost is the last
+    std::vector<Level> lexical_;
+};
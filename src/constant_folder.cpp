@@ -0,0 +1,160 @@
+#include "constant_folder.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "functions.h"
+#include "heap.h"
+
+static auto heap = GetHeap();
+
+ConstantFolder::ConstantFolder(Scope* globals) : globals_(globals) {
+}
+
+// Nodes are immutable, so a node with folded children is rebuilt.
+Node* ConstantFolder::Fold(Node* node) {
+    bool changed = false;
+    switch (node->kind) {
+        case NodeKind::Constant:
+        case NodeKind::Variable:
+        case NodeKind::Folded:
+            return node;
+        case NodeKind::If: {
+            auto if_node = static_cast<IfNode*>(node);
+            auto children = FoldAll(GetChildren(node), &changed);
+            if (!changed) {
+                return node;
+            }
+            return heap->Make<IfNode>(children[0], children[1],
+                                      if_node->alternative ? children[2] : nullptr);
+        }
+        case NodeKind::Define:
+        case NodeKind::Set: {
+            auto assign = static_cast<AssignNode*>(node);
+            auto value = Fold(assign->value);
+            if (value == assign->value) {
+                return node;
+            }
+            return heap->Make<AssignNode>(node->kind, assign->name, value);
+        }
+        case NodeKind::Lambda:
+            return FoldLambda(static_cast<LambdaNode*>(node));
+        case NodeKind::And:
+        case NodeKind::Or: {
+            auto operands = FoldAll(static_cast<LogicalNode*>(node)->operands, &changed);
+            if (!changed) {
+                return node;
+            }
+            return heap->Make<LogicalNode>(node->kind, std::move(operands));
+        }
+        case NodeKind::Call: {
+            auto call = static_cast<CallNode*>(node);
+            auto callee = Fold(call->callee);
+            auto arguments = FoldAll(call->arguments, &changed);
+            if (changed || callee != call->callee) {
+                call = heap->Make<CallNode>(callee, std::move(arguments), call->improper);
+            }
+            return FoldCall(call);
+        }
+        case NodeKind::Let:
+        case NodeKind::Letrec:
+        case NodeKind::Loop:
+            return FoldLet(static_cast<LetNode*>(node));
+        case NodeKind::Recur: {
+            auto arguments = FoldAll(static_cast<RecurNode*>(node)->arguments, &changed);
+            if (!changed) {
+                return node;
+            }
+            return heap->Make<RecurNode>(std::move(arguments));
+        }
+    }
+    return node;
+}
+
+std::vector<Node*> ConstantFolder::FoldAll(const std::vector<Node*>& nodes, bool* changed) {
+    std::vector<Node*> folded;
+    folded.reserve(nodes.size());
+    for (auto node : nodes) {
+        folded.push_back(Fold(node));
+        *changed |= folded.back() != node;
+    }
+    return folded;
+}
+
+Node* ConstantFolder::FoldLambda(LambdaNode* node) {
+    auto scope_size = locals_.size();
+    locals_.insert(locals_.end(), node->arguments.begin(), node->arguments.end());
+    auto defines = GetInternalDefines(node->body);
+    locals_.insert(locals_.end(), defines.begin(), defines.end());
+    bool changed = false;
+    auto body = FoldAll(node->body, &changed);
+    locals_.resize(scope_size);
+    if (!changed) {
+        return node;
+    }
+    return heap->Make<LambdaNode>(node->arguments, std::move(body));
+}
+
+Node* ConstantFolder::FoldLet(LetNode* node) {
+    auto scope_size = locals_.size();
+    const auto& names = node->scope_names;
+    if (node->kind == NodeKind::Letrec) {
+        locals_.insert(locals_.end(), names.begin(), names.end());
+    }
+    bool changed = false;
+    auto values = FoldAll(node->values, &changed);
+    locals_.resize(scope_size);
+    locals_.insert(locals_.end(), names.begin(), names.end());
+    auto body = FoldAll(node->body, &changed);
+    locals_.resize(scope_size);
+    if (!changed) {
+        return node;
+    }
+    return heap->Make<LetNode>(node->kind, node->names, std::move(values), std::move(body));
+}
+
+// The call is folded, if its callee is a global bound to a pure builtin and all the arguments
+// are constants. A call that fails is left to fail at run time.
+Node* ConstantFolder::FoldCall(CallNode* call) {
+    if (call->improper || call->callee->kind != NodeKind::Variable) {
+        return call;
+    }
+    auto name = static_cast<VariableNode*>(call->callee)->name;
+    auto binding = globals_->FindBinding(name);
+    if (IsLocal(name) || binding == nullptr || !Is<Function>(binding->value) ||
+        !As<Function>(binding->value)->IsPure()) {
+        return call;
+    }
+    std::vector<Object*> arguments;
+    std::vector<BindingGuard> guards;
+    for (auto argument : call->arguments) {
+        if (argument->kind == NodeKind::Constant) {
+            arguments.push_back(static_cast<ConstantNode*>(argument)->value);
+        } else if (argument->kind == NodeKind::Folded) {
+            auto folded = static_cast<FoldedNode*>(argument);
+            arguments.push_back(folded->value);
+            guards.insert(guards.end(), folded->guards.begin(), folded->guards.end());
+        } else {
+            return call;
+        }
+    }
+    Object* value = nullptr;
+    try {
+        // pure builtins do not use the interpreter
+        value = As<Function>(binding->value)->Call(nullptr, arguments);
+    } catch (const SyntaxError&) {
+        return call;
+    } catch (const RuntimeError&) {
+        return call;
+    } catch (const NameError&) {
+        return call;
+    }
+    guards.push_back({binding, binding->value});
+    return heap->Make<FoldedNode>(value, call, std::move(guards));
+}
+
+bool ConstantFolder::IsLocal(SymbolId name) const {
+    return std::find(locals_.begin(), locals_.end(), name) != locals_.end();
+}
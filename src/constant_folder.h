@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include "ast.h"
+#include "object.h"
+#include "symbols.h"
+
+// Computes calls of pure builtins with constant arguments before evaluation.
+// A folded call keeps the original node and is guarded by the bindings of the builtins it
+// called, so redefining any of them brings back the ordinary evaluation.
+class ConstantFolder {
+public:
+    explicit ConstantFolder(Scope* globals);
+
+    Node* Fold(Node* node);
+
+private:
+    std::vector<Node*> FoldAll(const std::vector<Node*>& nodes, bool* changed);
+    Node* FoldLambda(LambdaNode* node);
+    Node* FoldLet(LetNode* node);
+    Node* FoldCall(CallNode* call);
+    bool IsLocal(SymbolId name) const;
+
+    Scope* globals_;
+    // names bound by the enclosing lambdas and lets, they shadow the globals
+    std::vector<SymbolId> locals_;
+};
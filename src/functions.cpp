@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <cassert>
+#include <new>
 #include <stdexcept>
+#include <optional>
 #include <string>
 #include <vector>
 #include <tuple>
 
+#include "bytecode.h"
 #include "error.h"
 #include "functions.h"
 #include "int_type.h"
@@ -28,91 +32,81 @@ std::pair<Status, std::vector<Object*>> ToVector(Object* object) {
     return {status, answer};
 }
 
-static Object* ToList(const std::vector<Object*>& argument, size_t from, bool proper_list = true) {
+static Object* ToList(const ArgsType& argument, size_t from, bool proper_list = true) {
     if (from >= argument.size()) {
         return nullptr;
     }
-    if (!proper_list && from + 1 == argument.size()) {
-        return argument[from];
+    auto last = argument.size();
+    Object* answer = nullptr;
+    if (!proper_list) {
+        answer = argument[--last];
     }
-    Object* first = argument[from];
-    Object* second = ToList(argument, from + 1, proper_list);
-    return heap->Make<Cell>(first, second);
+    while (last > from) {
+        answer = heap->MakeCell(argument[--last], answer);
+    }
+    return answer;
 }
 
-Function::Function(FunctionInfo function_info) : function_info_(function_info) {
+Function::Function(FunctionInfo function_info, ObjectType type)
+    : BasicFunction(type), function_info_(function_info) {
 }
-Object* Function::Call(Interpreter* interpreter, Object* argument) {
-    auto args = GetArguments(interpreter, argument);
+// Error messages are built only when a check fails, so a call allocates nothing by itself.
+Object* Function::Call(Interpreter* interpreter, const ArgsType& arguments) {
+    CheckArgumentCount(arguments.size());
+    CheckArgumentTypes(arguments);
     interpreter_ = interpreter;
-    current_scope_ = interpreter->GetCurrentScope();
-    return Apply(args);
+    return Apply(arguments);
 }
-std::vector<Object*> Function::GetArguments(Interpreter* interpreter, Object* argument) {
-    auto& f_name = function_info_.name;
+void Function::CheckArgumentCount(size_t count) const {
     auto& min_arg = function_info_.min_arg_count;
     auto& max_arg = function_info_.max_arg_count;
-    auto& allow_improper = function_info_.allow_improper;
-    auto& execute_all = function_info_.execute_args;
-    auto& checker = function_info_.checker.checker;
-    auto& bad_message = function_info_.checker.bad_check_msg;
-    auto& syntax_error = function_info_.throw_syntax_error;
-    auto& raw_argument = function_info_.raw_argument;
 
-    if (raw_argument) {
-        return {argument};
-    }
-
-    std::string funtion_text = ".";
-    if (!f_name.empty()) {
-        funtion_text = " for function '" + f_name + "'.";
-    }
-
-    auto [status, v] = ToVector(argument);
-    if (!allow_improper && status == ImproperList) {
-        std::string message = "improper list can't be interpreted as arguments" + funtion_text;
-        throw SyntaxError(message);
-    }
-    if (v.size() < min_arg) {
-        std::string message = "not enough argyments" + funtion_text;
+    if (count < min_arg) {
+        std::string message = "not enough argyments" + GetFunctionText();
         message += " Exepected at least " + std::to_string(min_arg);
-        message += ", but got " + std::to_string(v.size()) + ".";
-        if (syntax_error) {
-            throw SyntaxError(message);
-        }
+        message += ", but got " + std::to_string(count) + ".";
         throw RuntimeError(message);
     }
-    if (v.size() > max_arg) {
-        std::string message = "too many argyments" + funtion_text;
+    if (count > max_arg) {
+        std::string message = "too many argyments" + GetFunctionText();
         message += " Exepected at most " + std::to_string(max_arg);
-        message += ", but got " + std::to_string(v.size()) + ".";
-        if (syntax_error) {
-            throw SyntaxError(message);
-        }
+        message += ", but got " + std::to_string(count) + ".";
         throw RuntimeError(message);
     }
-    if (execute_all) {
-        for (auto& arg : v) {
-            arg = interpreter->Execute(arg);
-        }
+}
+void Function::CheckArgumentTypes(const ArgsType& arguments) const {
+    auto& checker = function_info_.checker.checker;
+    auto& bad_message = function_info_.checker.bad_check_msg;
+
+    if (checker == nullptr) {
+        return;
     }
-    if (checker != nullptr) {
-        for (size_t i = 0; i < v.size(); ++i) {
-            if (!checker(v[i])) {
-                std::string message = "bad argument #" + std::to_string(i) + funtion_text;
-                if (!bad_message.empty()) {
-                    message += "\ninfo: " + bad_message;
-                }
-                throw RuntimeError(message);
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        if (!checker(arguments[i])) {
+            std::string message = "bad argument #" + std::to_string(i) + GetFunctionText();
+            if (!bad_message.empty()) {
+                message += "\ninfo: " + bad_message;
             }
+            throw RuntimeError(message);
         }
     }
-    return v;
+}
+std::string Function::GetFunctionText() const {
+    if (function_info_.name.empty()) {
+        return ".";
+    }
+    return " for function '" + function_info_.name + "'.";
 }
 
 std::string Function::GetName() const {
     return function_info_.name;
 }
+bool Function::IsPure() const {
+    return function_info_.pure;
+}
+bool Function::IsMutator() const {
+    return function_info_.mutator;
+}
 std::string Function::ToString() const {
     return "<function '" + function_info_.name + "'>";
 }
@@ -127,14 +121,8 @@ static Checker is_num_checker{
     .bad_check_msg = "accepts only numbers",
 };
 
-static bool IsTrue(Object* object) {
-    if (!Is<Symbol>(object)) {
-        return true;
-    }
-    if (As<Symbol>(object)->GetName() != "#f") {
-        return true;
-    }
-    return false;
+bool IsTrue(Object* object) {
+    return object != Boolean(false);
 }
 
 // realisations
@@ -143,13 +131,14 @@ IsNumber::IsNumber()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "number?",
+          .pure = true,
       }) {
 }
 Object* IsNumber::Apply(const ArgsType& arguments) {
     if (Is<Number>(arguments[0])) {
-        return heap->Make<Symbol>("#t");
+        return Boolean(true);
     }
-    return heap->Make<Symbol>("#f");
+    return Boolean(false);
 }
 
 IsMonotonic::IsMonotonic(bool (*comparator)(Int, Int), std::string function_name)
@@ -158,71 +147,91 @@ IsMonotonic::IsMonotonic(bool (*comparator)(Int, Int), std::string function_name
           .max_arg_count = static_cast<size_t>(-1),
           .name = function_name,
           .checker = is_num_checker,
-      }},
+          .pure = true,
+      },
+      ObjectType::IsMonotonic},
       comparator_(comparator) {
 }
 Object* IsMonotonic::Apply(const ArgsType& arguments) {
-    if (arguments.size() < 2) {
-        return heap->Make<Symbol>("#t");
-    }
-    auto prev = As<Number>(arguments[0])->GetValue();
     for (size_t i = 1; i < arguments.size(); ++i) {
-        auto current = As<Number>(arguments[i])->GetValue();
-        if (!comparator_(prev, current)) {
-            return heap->Make<Symbol>("#f");
+        if (!Holds(arguments[i - 1], arguments[i])) {
+            return Boolean(false);
         }
-        prev = current;
     }
-    return heap->Make<Symbol>("#t");
+    return Boolean(true);
+}
+
+bool IsMonotonic::Holds(Object* lhs, Object* rhs) const {
+    if (IsFixnum(lhs) && IsFixnum(rhs)) {
+        return comparator_(GetFixnumValue(lhs), GetFixnumValue(rhs));
+    }
+    auto order = GetBigValue(lhs) <=> GetBigValue(rhs);
+    return comparator_(order < 0 ? -1 : (order > 0 ? 1 : 0), 0);
 }
 
-IntOperations::IntOperations(Int (*apply)(Int, Int), Int default_value, size_t min_arg_count,
-                             size_t max_arg_count, std::string function_name)
+bool (*IsMonotonic::GetComparator() const)(Int, Int) {
+    return comparator_;
+}
+
+IntOperations::IntOperations(std::optional<Int> (*apply)(Int, Int),
+                             BigInt (*apply_big)(const BigInt&, const BigInt&),
+                             Int default_value, size_t min_arg_count, size_t max_arg_count,
+                             std::string function_name)
     : Function({
           .min_arg_count = min_arg_count,
           .max_arg_count = max_arg_count,
           .name = function_name,
           .checker = is_num_checker,
-      }),
+          .pure = true,
+      },
+      ObjectType::IntOperations),
       default_value_(default_value),
-      apply_(apply) {
+      apply_(apply),
+      apply_big_(apply_big) {
 }
 Object* IntOperations::Apply(const ArgsType& arguments) {
     if (arguments.empty()) {
-        return heap->Make<Number>(default_value_);
+        return MakeNumber(default_value_);
     }
-    auto answer = As<Number>(arguments[0])->GetValue();
+    auto answer = arguments[0];
     for (size_t i = 1; i < arguments.size(); ++i) {
-        auto current = As<Number>(arguments[i])->GetValue();
-        answer = apply_(answer, current);
+        answer = Combine(answer, arguments[i]);
     }
-    return heap->Make<Number>(answer);
+    return answer;
 }
 
-IntSoloArgumentOperation::IntSoloArgumentOperation(Int (*apply)(Int), std::string function_name)
+// Fixnums are computed directly, a big operand or an overflow switches to BigInt.
+Object* IntOperations::Combine(Object* lhs, Object* rhs) const {
+    if (IsFixnum(lhs) && IsFixnum(rhs)) {
+        if (auto result = apply_(GetFixnumValue(lhs), GetFixnumValue(rhs))) {
+            return MakeNumber(*result);
+        }
+    }
+    return MakeNumber(apply_big_(GetBigValue(lhs), GetBigValue(rhs)));
+}
+
+std::optional<Int> (*IntOperations::GetOperation() const)(Int, Int) {
+    return apply_;
+}
+
+IntSoloArgumentOperation::IntSoloArgumentOperation(Int (*apply)(Int),
+                                                   BigInt (*apply_big)(const BigInt&),
+                                                   std::string function_name)
     : Function({
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = function_name,
           .checker = is_num_checker,
+          .pure = true,
       }),
-      apply_(apply) {
+      apply_(apply),
+      apply_big_(apply_big) {
 }
 Object* IntSoloArgumentOperation::Apply(const ArgsType& arguments) {
-    Int answer = apply_(As<Number>(arguments[0])->GetValue());
-    return heap->Make<Number>(answer);
-}
-
-Quote::Quote()
-    : Function({
-          .min_arg_count = 1,
-          .max_arg_count = 1,
-          .name = "quote",
-          .execute_args = false,
-      }) {
-}
-Object* Quote::Apply(const ArgsType& arguments) {
-    return arguments[0];
+    if (IsFixnum(arguments[0])) {
+        return MakeNumber(apply_(GetFixnumValue(arguments[0])));
+    }
+    return MakeNumber(apply_big_(GetBigValue(arguments[0])));
 }
 
 IsBoolean::IsBoolean()
@@ -230,17 +239,11 @@ IsBoolean::IsBoolean()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "boolean?",
+          .pure = true,
       }) {
 }
 Object* IsBoolean::Apply(const ArgsType& arguments) {
-    if (!Is<Symbol>(arguments[0])) {
-        return heap->Make<Symbol>("#f");
-    }
-    auto str = As<Symbol>(arguments[0])->GetName();
-    if (str == "#t" || str == "#f") {
-        return heap->Make<Symbol>("#t");
-    }
-    return heap->Make<Symbol>("#f");
+    return Boolean(arguments[0] == Boolean(true) || arguments[0] == Boolean(false));
 }
 
 Not::Not()
@@ -248,51 +251,14 @@ Not::Not()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "not",
+          .pure = true,
       }) {
 }
 Object* Not::Apply(const ArgsType& arguments) {
     if (IsTrue(arguments[0])) {
-        return heap->Make<Symbol>("#f");
-    }
-    return heap->Make<Symbol>("#t");
-}
-
-And::And()
-    : Function({
-          .min_arg_count = 0,
-          .max_arg_count = static_cast<size_t>(-1),
-          .name = "and",
-          .execute_args = false,
-      }) {
-}
-Object* And::Apply(const ArgsType& arguments) {
-    Object* last_expr = heap->Make<Symbol>("#t");
-    for (auto& arg : arguments) {
-        last_expr = interpreter_->Execute(arg);
-        if (!IsTrue(last_expr)) {
-            break;
-        }
-    }
-    return last_expr;
-}
-
-Or::Or()
-    : Function({
-          .min_arg_count = 0,
-          .max_arg_count = static_cast<size_t>(-1),
-          .name = "or",
-          .execute_args = false,
-      }) {
-}
-Object* Or::Apply(const ArgsType& arguments) {
-    Object* last_expr = heap->Make<Symbol>("#f");
-    for (auto& arg : arguments) {
-        last_expr = interpreter_->Execute(arg);
-        if (IsTrue(last_expr)) {
-            break;
-        }
+        return Boolean(false);
     }
-    return last_expr;
+    return Boolean(true);
 }
 
 IsPair::IsPair()
@@ -300,14 +266,14 @@ IsPair::IsPair()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "pair?",
+          .pure = true,
       }) {
 }
 Object* IsPair::Apply(const ArgsType& arguments) {
-    auto [status, v] = ToVector(arguments[0]);
     if (Is<Cell>(arguments[0])) {
-        return heap->Make<Symbol>("#t");
+        return Boolean(true);
     }
-    return heap->Make<Symbol>("#f");
+    return Boolean(false);
 }
 
 IsNull::IsNull()
@@ -315,14 +281,14 @@ IsNull::IsNull()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "null?",
+          .pure = true,
       }) {
 }
 Object* IsNull::Apply(const ArgsType& arguments) {
-    auto [status, v] = ToVector(arguments[0]);
-    if (v.empty()) {
-        return heap->Make<Symbol>("#t");
+    if (arguments[0] == nullptr) {
+        return Boolean(true);
     }
-    return heap->Make<Symbol>("#f");
+    return Boolean(false);
 }
 
 IsList::IsList()
@@ -330,14 +296,15 @@ IsList::IsList()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "list?",
+          .pure = true,
       }) {
 }
 Object* IsList::Apply(const ArgsType& arguments) {
-    auto [status, v] = ToVector(arguments[0]);
-    if (status == ProperList) {
-        return heap->Make<Symbol>("#t");
+    auto object = arguments[0];
+    while (Is<Cell>(object)) {
+        object = As<Cell>(object)->GetSecond();
     }
-    return heap->Make<Symbol>("#f");
+    return Boolean(object == nullptr);
 }
 
 Cons::Cons()
@@ -348,7 +315,7 @@ Cons::Cons()
       }) {
 }
 Object* Cons::Apply(const ArgsType& arguments) {
-    return heap->Make<Cell>(arguments[0], arguments[1]);
+    return heap->MakeCell(arguments[0], arguments[1]);
 }
 
 Car::Car()
@@ -356,6 +323,7 @@ Car::Car()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "car",
+          .pure = true,
       }) {
 }
 Object* Car::Apply(const ArgsType& arguments) {
@@ -370,6 +338,7 @@ Cdr::Cdr()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "cdr",
+          .pure = true,
       }) {
 }
 Object* Cdr::Apply(const ArgsType& arguments) {
@@ -395,18 +364,30 @@ ListRef::ListRef()
           .min_arg_count = 2,
           .max_arg_count = 2,
           .name = "list-ref",
+          .pure = true,
       }) {
 }
+// Walks the list up to the index instead of copying it. The tail of an improper list counts
+// as its last element.
 Object* ListRef::Apply(const ArgsType& arguments) {
-    auto [status, v] = ToVector(arguments[0]);
     if (!Is<Number>(arguments[1])) {
         throw RuntimeError("argument #1 for function list-ref shoud be Number");
     }
-    Int index = As<Number>(arguments[1])->GetValue();
-    if (index < 0 || index >= static_cast<Int>(v.size())) {
-        throw RuntimeError("argument #1 for function list-ref is out of range");
+    Int index = GetNumberValue(arguments[1]);
+    auto current = arguments[0];
+    for (Int i = 0; index >= 0 && current != nullptr; ++i) {
+        if (!Is<Cell>(current)) {
+            if (i == index) {
+                return current;
+            }
+            break;
+        }
+        if (i == index) {
+            return As<Cell>(current)->GetFirst();
+        }
+        current = As<Cell>(current)->GetSecond();
     }
-    return v[index];
+    throw RuntimeError("argument #1 for function list-ref is out of range");
 }
 
 ListTail::ListTail()
@@ -414,6 +395,7 @@ ListTail::ListTail()
           .min_arg_count = 2,
           .max_arg_count = 2,
           .name = "list-tail",
+          .pure = true,
       }) {
 }
 Object* ListTail::Apply(const ArgsType& arguments) {
@@ -421,7 +403,7 @@ Object* ListTail::Apply(const ArgsType& arguments) {
         throw RuntimeError("argument #1 for funtion list-tail shoud be Number");
     }
     auto ans = arguments[0];
-    Int index = As<Number>(arguments[1])->GetValue();
+    Int index = GetNumberValue(arguments[1]);
     while (index > 0) {
         if (ans == nullptr || !Is<Cell>(ans)) {
             throw RuntimeError("argument #2 for function list-tail is out of range");
@@ -437,147 +419,475 @@ IsSymbol::IsSymbol()
           .min_arg_count = 1,
           .max_arg_count = 1,
           .name = "symbol?",
+          .pure = true,
       }) {
 }
 Object* IsSymbol::Apply(const ArgsType& arguments) {
     if (Is<Symbol>(arguments[0])) {
-        return heap->Make<Symbol>("#t");
+        return Boolean(true);
     }
-    return heap->Make<Symbol>("#f");
+    return Boolean(false);
 }
 
-If::If()
+SetCar::SetCar()
     : Function({
           .min_arg_count = 2,
-          .max_arg_count = 3,
-          .name = "if",
-          .execute_args = false,
-          .throw_syntax_error = true,
+          .max_arg_count = 2,
+          .name = "set-car!",
+          .mutator = true,
       }) {
 }
-Object* If::Apply(const ArgsType& arguments) {
-    auto value = interpreter_->Execute(arguments[0]);
-    if (IsTrue(value)) {
-        return interpreter_->Execute(arguments[1]);
-    } else {
-        if (arguments.size() < 3) {
-            return nullptr;
-        }
-        return interpreter_->Execute(arguments[2]);
+Object* SetCar::Apply(const ArgsType& arguments) {
+    auto& var = arguments[0];
+    if (!Is<Cell>(var)) {
+        throw RuntimeError("argument #0 for funtion set-car! shoud be Symbol converting to pair");
     }
+    As<Cell>(var)->SetFirst(arguments[1]);
+    return Unspecified();
 }
 
-Lambda* CreateLambda(const std::vector<Object*>& args_names, int from, Scope* scope,
-                     Object* calls) {
-    auto answer = heap->Make<Lambda>();
-    answer->name = "lambda_" + std::to_string(LambdaFunction::free_index++);
+SetCdr::SetCdr()
+    : Function({
+          .min_arg_count = 2,
+          .max_arg_count = 2,
+          .name = "set-cdr!",
+          .mutator = true,
+      }) {
+}
+Object* SetCdr::Apply(const ArgsType& arguments) {
+    auto& var = arguments[0];
+    if (!Is<Cell>(var)) {
+        throw RuntimeError("argument #0 for funtion set-car! shoud be Symbol converting to pair");
+    }
+    As<Cell>(var)->SetSecond(arguments[1]);
+    return Unspecified();
+}
 
-    answer->SetScope(scope);
+static Vector* GetVectorArgument(Object* object, const std::string& function) {
+    if (!Is<Vector>(object)) {
+        throw RuntimeError("argument #0 for function " + function + " should be vector");
+    }
+    return As<Vector>(object);
+}
 
-    for (size_t i = from; i < args_names.size(); ++i) {
-        auto& la = args_names[i];
-        if (!Is<Symbol>(la)) {
-            throw RuntimeError("only symbols could be lambda arguments.");
-        }
-        answer->arguments.push_back(As<Symbol>(la)->GetName());
+static size_t GetVectorIndex(Vector* vector, Object* index, const std::string& function) {
+    if (!Is<Number>(index)) {
+        throw RuntimeError("argument #1 for function " + function + " should be Number");
     }
-    answer->SetCall(calls);
-    return answer;
+    // a big number is out of range of any vector
+    if (!IsFixnum(index) || GetFixnumValue(index) < 0 ||
+        GetFixnumValue(index) >= static_cast<Int>(vector->GetSize())) {
+        throw RuntimeError("argument #1 for function " + function + " is out of range");
+    }
+    return GetFixnumValue(index);
 }
 
-Define::Define()
+MakeVector::MakeVector()
     : Function({
-          .min_arg_count = 2,
-          .max_arg_count = static_cast<size_t>(-1),
-          .name = "define",
-          .execute_args = false,
-          .throw_syntax_error = true,
+          .min_arg_count = 1,
+          .max_arg_count = 2,
+          .name = "make-vector",
       }) {
 }
-Object* Define::Apply(const ArgsType& arguments) {
-    if (Is<Symbol>(arguments[0])) {
-        if (arguments.size() > 2) {
-            throw SyntaxError("too many arguments for function 'define'");
-        }
-        auto value = interpreter_->Execute(arguments[1]);
-        interpreter_->DefineValue(As<Symbol>(arguments[0])->GetName(), value);
-        return heap->Make<Empty>();
+Object* MakeVector::Apply(const ArgsType& arguments) {
+    if (!IsFixnum(arguments[0]) || GetFixnumValue(arguments[0]) < 0) {
+        throw RuntimeError("argument #0 for function make-vector should be non-negative number");
     }
-    // lambda sugar
-    if (!Is<Cell>(arguments[0])) {
-        throw SyntaxError("incorrect usage of define");
+    auto size = static_cast<size_t>(GetFixnumValue(arguments[0]));
+    if (size > std::min(kMaxSize, std::vector<Object*>().max_size())) {
+        throw RuntimeError("argument #0 for function make-vector is too large");
     }
-    auto [_, lambda_params] = ToVector(arguments[0]);
-    if (!Is<Symbol>(lambda_params[0])) {
-        throw SyntaxError("incorrect function name");
+    auto fill = arguments.size() == 2 ? arguments[1] : MakeNumber(0);
+    std::vector<Object*> elements;
+    try {
+        elements.assign(size, fill);
+    } catch (const std::bad_alloc&) {
+        throw RuntimeError("not enough memory for a vector of " + std::to_string(size) +
+                           " elements");
     }
-    auto calls = ToList(arguments, 1);
-    auto ans = CreateLambda(lambda_params, 1, current_scope_, calls);
-    interpreter_->DefineValue(As<Symbol>(lambda_params[0])->GetName(), ans);
-    return heap->Make<Empty>();
+    return heap->Make<Vector>(std::move(elements));
+}
+
+VectorOf::VectorOf()
+    : Function({
+          .min_arg_count = 0,
+          .max_arg_count = static_cast<size_t>(-1),
+          .name = "vector",
+      }) {
+}
+Object* VectorOf::Apply(const ArgsType& arguments) {
+    return heap->Make<Vector>(std::vector<Object*>(arguments.begin(), arguments.end()));
 }
 
-Set::Set()
+VectorRef::VectorRef()
     : Function({
           .min_arg_count = 2,
           .max_arg_count = 2,
-          .name = "set!",
-          .execute_args = false,
-          .throw_syntax_error = true,
+          .name = "vector-ref",
       }) {
 }
-Object* Set::Apply(const ArgsType& arguments) {
-    if (!Is<Symbol>(arguments[0])) {
-        throw RuntimeError("argument #0 for function set! shoud be Symbol");
-    }
-    auto value = interpreter_->Execute(arguments[1]);
-    interpreter_->SetValue(As<Symbol>(arguments[0])->GetName(), value);
-    return heap->Make<Empty>();
+Object* VectorRef::Apply(const ArgsType& arguments) {
+    auto vector = GetVectorArgument(arguments[0], GetName());
+    return vector->Get(GetVectorIndex(vector, arguments[1], GetName()));
 }
 
-SetCar::SetCar()
+VectorSet::VectorSet()
+    : Function({
+          .min_arg_count = 3,
+          .max_arg_count = 3,
+          .name = "vector-set!",
+          .mutator = true,
+      }) {
+}
+Object* VectorSet::Apply(const ArgsType& arguments) {
+    auto vector = GetVectorArgument(arguments[0], GetName());
+    vector->Set(GetVectorIndex(vector, arguments[1], GetName()), arguments[2]);
+    return Unspecified();
+}
+
+VectorLength::VectorLength()
+    : Function({
+          .min_arg_count = 1,
+          .max_arg_count = 1,
+          .name = "vector-length",
+      }) {
+}
+Object* VectorLength::Apply(const ArgsType& arguments) {
+    return MakeNumber(static_cast<Int>(GetVectorArgument(arguments[0], GetName())->GetSize()));
+}
+
+VectorFill::VectorFill()
     : Function({
           .min_arg_count = 2,
           .max_arg_count = 2,
-          .name = "set-car!",
+          .name = "vector-fill!",
+          .mutator = true,
       }) {
 }
-Object* SetCar::Apply(const ArgsType& arguments) {
-    auto& var = arguments[0];
-    if (!Is<Cell>(var)) {
-        throw RuntimeError("argument #0 for funtion set-car! shoud be Symbol converting to pair");
+Object* VectorFill::Apply(const ArgsType& arguments) {
+    GetVectorArgument(arguments[0], GetName())->Fill(arguments[1]);
+    return Unspecified();
+}
+
+ListToVector::ListToVector()
+    : Function({
+          .min_arg_count = 1,
+          .max_arg_count = 1,
+          .name = "list->vector",
+      }) {
+}
+Object* ListToVector::Apply(const ArgsType& arguments) {
+    auto [status, elements] = ToVector(arguments[0]);
+    if (status == ImproperList) {
+        throw RuntimeError("argument #0 for function list->vector should be list");
     }
-    As<Cell>(var)->SetFirst(arguments[1]);
-    return heap->Make<Empty>();
+    return heap->Make<Vector>(std::move(elements));
 }
 
-SetCdr::SetCdr()
+VectorToList::VectorToList()
     : Function({
-          .min_arg_count = 2,
-          .max_arg_count = 2,
-          .name = "set-cdr!",
+          .min_arg_count = 1,
+          .max_arg_count = 1,
+          .name = "vector->list",
       }) {
 }
-Object* SetCdr::Apply(const ArgsType& arguments) {
-    auto& var = arguments[0];
-    if (!Is<Cell>(var)) {
-        throw RuntimeError("argument #0 for funtion set-car! shoud be Symbol converting to pair");
+Object* VectorToList::Apply(const ArgsType& arguments) {
+    return ToList(GetVectorArgument(arguments[0], GetName())->GetElements(), 0);
+}
+
+static bool IsStringCheck(Object* object) {
+    return Is<String>(object);
+}
+
+static Checker is_string_checker{
+    .checker = IsStringCheck,
+    .bad_check_msg = "accepts only strings",
+};
+
+IsString::IsString()
+    : Function({
+          .min_arg_count = 1,
+          .max_arg_count = 1,
+          .name = "string?",
+          .pure = true,
+      }) {
+}
+Object* IsString::Apply(const ArgsType& arguments) {
+    return Boolean(Is<String>(arguments[0]));
+}
+
+StringAppend::StringAppend()
+    : Function({
+          .min_arg_count = 0,
+          .max_arg_count = static_cast<size_t>(-1),
+          .name = "string-append",
+          .checker = is_string_checker,
+          .pure = true,
+      }) {
+}
+Object* StringAppend::Apply(const ArgsType& arguments) {
+    if (arguments.empty()) {
+        return MakeString("");
     }
-    As<Cell>(var)->SetSecond(arguments[1]);
-    return heap->Make<Empty>();
+    auto answer = As<String>(arguments[0]);
+    for (size_t i = 1; i < arguments.size(); ++i) {
+        answer = ConcatStrings(answer, As<String>(arguments[i]));
+    }
+    return answer;
 }
 
-LambdaFunction::LambdaFunction()
+Substring::Substring()
     : Function({
           .min_arg_count = 2,
+          .max_arg_count = 3,
+          .name = "substring",
+          .pure = true,
+      }) {
+}
+Object* Substring::Apply(const ArgsType& arguments) {
+    if (!Is<String>(arguments[0])) {
+        throw RuntimeError("argument #0 for function substring should be string");
+    }
+    auto view = As<String>(arguments[0])->GetView();
+    // a big number is out of range of any string
+    auto get_index = [&arguments, &view](size_t i, Int from) {
+        if (!Is<Number>(arguments[i])) {
+            throw RuntimeError("argument #" + std::to_string(i) +
+                               " for function substring should be Number");
+        }
+        if (!IsFixnum(arguments[i]) || GetFixnumValue(arguments[i]) < from ||
+            GetFixnumValue(arguments[i]) > static_cast<Int>(view.size())) {
+            throw RuntimeError("argument #" + std::to_string(i) +
+                               " for function substring is out of range");
+        }
+        return static_cast<size_t>(GetFixnumValue(arguments[i]));
+    };
+    auto start = get_index(1, 0);
+    auto end = arguments.size() == 3 ? get_index(2, start) : view.size();
+    return MakeString(view.substr(start, end - start));
+}
+
+StringLength::StringLength()
+    : Function({
+          .min_arg_count = 1,
+          .max_arg_count = 1,
+          .name = "string-length",
+          .checker = is_string_checker,
+          .pure = true,
+      }) {
+}
+Object* StringLength::Apply(const ArgsType& arguments) {
+    return MakeNumber(static_cast<Int>(As<String>(arguments[0])->GetSize()));
+}
+
+StringEquals::StringEquals()
+    : Function({
+          .min_arg_count = 1,
           .max_arg_count = static_cast<size_t>(-1),
-          .name = "lambda",
-          .execute_args = false,
-          .throw_syntax_error = true,
+          .name = "string=?",
+          .checker = is_string_checker,
+          .pure = true,
       }) {
 }
-Object* LambdaFunction::Apply(const ArgsType& arguments) {
-    auto [status, lambda_args] = ToVector(arguments[0]);
-    auto ans = CreateLambda(lambda_args, 0, current_scope_, ToList(arguments, 1));
-    return ans;
+Object* StringEquals::Apply(const ArgsType& arguments) {
+    auto first = As<String>(arguments[0]);
+    for (size_t i = 1; i < arguments.size(); ++i) {
+        auto current = As<String>(arguments[i]);
+        // sizes are known without flattening ropes
+        if (current->GetSize() != first->GetSize() || current->GetView() != first->GetView()) {
+            return Boolean(false);
+        }
+    }
+    return Boolean(true);
+}
+
+StringToSymbol::StringToSymbol()
+    : Function({
+          .min_arg_count = 1,
+          .max_arg_count = 1,
+          .name = "string->symbol",
+          .checker = is_string_checker,
+          .pure = true,
+      }) {
+}
+Object* StringToSymbol::Apply(const ArgsType& arguments) {
+    return MakeSymbol(Intern(std::string(As<String>(arguments[0])->GetView())));
+}
+
+SymbolToString::SymbolToString()
+    : Function({
+          .min_arg_count = 1,
+          .max_arg_count = 1,
+          .name = "symbol->string",
+          .pure = true,
+      }) {
+}
+Object* SymbolToString::Apply(const ArgsType& arguments) {
+    if (!Is<Symbol>(arguments[0])) {
+        throw RuntimeError("argument #0 for function symbol->string should be Symbol");
+    }
+    return MakeString(As<Symbol>(arguments[0])->GetName());
+}
+
+Memoized::Memoized(Object* function, size_t capacity)
+    : Function({
+          .min_arg_count = 0,
+          .max_arg_count = static_cast<size_t>(-1),
+          .name = "memoized",
+      },
+      ObjectType::Memoized),
+      function_(function),
+      capacity_(capacity) {
+}
+Object* Memoized::Apply(const ArgsType& arguments) {
+    // the arguments could move while the function runs
+    Key key(arguments.begin(), arguments.end());
+    bool cached = std::none_of(key.begin(), key.end(), [](Object* object) {
+        return Is<Cell>(object) || Is<Vector>(object);
+    });
+    if (cached) {
+        if (auto it = index_.find(key); it != index_.end()) {
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return it->second->second;
+        }
+    }
+    auto value = interpreter_->Apply(function_, key);
+    // a recursive call could have cached it already
+    if (!cached || index_.contains(key)) {
+        return value;
+    }
+    entries_.emplace_front(key, value);
+    index_.emplace(std::move(key), entries_.begin());
+    if (entries_.size() > capacity_) {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+    return value;
+}
+void Memoized::Trace(std::vector<Object*>* edges) const {
+    edges->push_back(function_);
+    for (auto& [key, value] : entries_) {
+        edges->insert(edges->end(), key.begin(), key.end());
+        edges->push_back(value);
+    }
+}
+// Big numbers are compared by value, other objects by identity: symbols are interned and
+// a fixnum is its value.
+size_t Memoized::KeyHash::operator()(const Key& key) const {
+    size_t hash = key.size();
+    for (auto object : key) {
+        size_t part = std::hash<Object*>()(object);
+        if (!IsFixnum(object) && Is<Number>(object)) {
+            part = As<Number>(object)->GetValue().Hash();
+        }
+        hash = hash * 31 + part;
+    }
+    return hash;
+}
+bool Memoized::KeyEqual::operator()(const Key& lhs, const Key& rhs) const {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (!IsFixnum(lhs[i]) && !IsFixnum(rhs[i]) && Is<Number>(lhs[i]) && Is<Number>(rhs[i])) {
+            if (As<Number>(lhs[i])->GetValue() != As<Number>(rhs[i])->GetValue()) {
+                return false;
+            }
+        } else if (lhs[i] != rhs[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Memoize::Memoize()
+    : Function({
+          .min_arg_count = 1,
+          .max_arg_count = 2,
+          .name = "memoize",
+      }) {
+}
+// The value of a free name of a lambda: the scopes of the lambda are searched,
+// a closure has it captured or reads it from the global scope.
+static Object* GetFreeValue(Object* function, SymbolId name, Scope* globals) {
+    if (Is<Lambda>(function)) {
+        for (auto scope = As<Lambda>(function)->GetScope(); scope; scope = scope->GetPrevios()) {
+            if (auto binding = scope->FindBinding(name)) {
+                return binding->value;
+            }
+        }
+        return nullptr;
+    }
+    auto closure = As<Closure>(function);
+    const auto& captures = closure->GetPrototype()->captures;
+    for (size_t i = 0; i < captures.size(); ++i) {
+        if (captures[i].name == name) {
+            auto value = closure->GetCapture(i);
+            return Is<Box>(value) ? As<Box>(value)->Get() : value;
+        }
+    }
+    auto binding = globals->FindBinding(name);
+    return binding ? binding->value : nullptr;
+}
+
+// Functions called through the free names are checked as well. The ones in checked are
+// skipped, this also covers a function defined through memoize calling itself.
+static bool HasSideEffects(Object* function, Scope* globals, std::vector<Object*>* checked) {
+    if (std::find(checked->begin(), checked->end(), function) != checked->end()) {
+        return false;
+    }
+    checked->push_back(function);
+    bool mutates = false;
+    const std::vector<SymbolId>* free_names = nullptr;
+    if (Is<Lambda>(function)) {
+        auto code = As<Lambda>(function)->GetCode();
+        mutates = code->mutates_outer_state;
+        free_names = &code->free_names;
+    } else if (Is<Closure>(function)) {
+        auto prototype = As<Closure>(function)->GetPrototype();
+        mutates = prototype->mutates_outer_state;
+        free_names = &prototype->free_names;
+    } else if (Is<Memoized>(function)) {
+        return false;
+    } else if (Is<Function>(function)) {
+        return As<Function>(function)->IsMutator();
+    } else {
+        return false;
+    }
+    if (mutates) {
+        return true;
+    }
+    for (auto name : *free_names) {
+        auto value = GetFreeValue(function, name, globals);
+        if (value && value != Unbound() && HasSideEffects(value, globals, checked)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Object* Memoize::Apply(const ArgsType& arguments) {
+    auto function = arguments[0];
+    bool pure = false;
+    if (Is<Lambda>(function) || Is<Closure>(function)) {
+        std::vector<Object*> checked;
+        pure = !HasSideEffects(function, interpreter_->GetGlobalScope(), &checked);
+    } else if (Is<Memoized>(function)) {
+        pure = true;
+    } else if (Is<Function>(function)) {
+        pure = As<Function>(function)->IsPure();
+    } else {
+        throw RuntimeError("argument #0 for function memoize shoud be function");
+    }
+    if (!pure) {
+        throw RuntimeError("function with side effects can't be memoized");
+    }
+    size_t capacity = kDefaultCapacity;
+    if (arguments.size() == 2) {
+        if (!Is<Number>(arguments[1]) || GetNumberValue(arguments[1]) <= 0) {
+            throw RuntimeError("argument #1 for function memoize shoud be positive number");
+        }
+        capacity = GetNumberValue(arguments[1]);
+    }
+    return heap->Make<Memoized>(function, capacity);
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <list>
 #include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "object.h"
@@ -14,7 +17,7 @@ enum Status {
 
 std::pair<Status, std::vector<Object*>> ToVector(Object* object);
 
-using ArgsType = std::vector<Object*>;
+bool IsTrue(Object* object);
 
 struct Checker {
     bool (*checker)(Object*) = nullptr;
@@ -25,30 +28,33 @@ struct FunctionInfo {
     size_t min_arg_count;
     size_t max_arg_count;
     std::string name;
-    bool allow_improper = false;
-    bool execute_args = true;
     Checker checker{
         .checker = nullptr,
         .bad_check_msg = std::string(),
     };
-    bool throw_syntax_error = false;
-    bool raw_argument = false;
+    // result depends on the arguments only, so it could be computed ahead of time
+    bool pure = false;
+    // changes its arguments
+    bool mutator = false;
 };
 
 struct Function : public BasicFunction {
-    explicit Function(FunctionInfo function_info);
-    Object* Call(Interpreter* interpreter, Object* argument) override;
+    explicit Function(FunctionInfo function_info, ObjectType type = ObjectType::Function);
+    Object* Call(Interpreter* interpreter, const ArgsType& arguments) override;
     virtual Object* Apply(const ArgsType& arguments) = 0;
 
     std::string GetName() const;
+    bool IsPure() const;
+    bool IsMutator() const;
     std::string ToString() const override;
 
 protected:
     Interpreter* interpreter_;
-    Scope* current_scope_;
 
 private:
-    ArgsType GetArguments(Interpreter* interpreter, Object* argument);
+    void CheckArgumentCount(size_t count) const;
+    void CheckArgumentTypes(const ArgsType& arguments) const;
+    std::string GetFunctionText() const;
     FunctionInfo function_info_;
 };
 
@@ -57,35 +63,54 @@ struct IsNumber : Function {
     Object* Apply(const ArgsType& arguments) override;
 };
 
+template <>
+struct TypeRange<Function> : TypeRangeOf<ObjectType::Function, ObjectType::Memoized> {};
+
+// The comparator is applied to the values of fixnums, and to -1, 0 or 1 and 0 when one of the
+// numbers is big: the sign of their difference.
 struct IsMonotonic : public Function {
     IsMonotonic(bool (*comparator)(Int, Int), std::string function_name);
     Object* Apply(const ArgsType& arguments) override;
+    bool (*GetComparator() const)(Int, Int);
 
 private:
+    bool Holds(Object* lhs, Object* rhs) const;
+
     bool (*comparator_)(Int, Int);
 };
 
+// apply computes the operation on fixnums and returns nullopt if the result overflows Int,
+// apply_big computes it on numbers of any size. The result is demoted back to a fixnum
+// whenever it fits.
 struct IntOperations : public Function {
-    IntOperations(Int (*apply)(Int, Int), Int default_value, size_t min_arg_count,
-                  size_t max_arg_count, std::string function_name);
+    IntOperations(std::optional<Int> (*apply)(Int, Int),
+                  BigInt (*apply_big)(const BigInt&, const BigInt&), Int default_value,
+                  size_t min_arg_count, size_t max_arg_count, std::string function_name);
     Object* Apply(const ArgsType& arguments) override;
+    std::optional<Int> (*GetOperation() const)(Int, Int);
 
 private:
+    Object* Combine(Object* lhs, Object* rhs) const;
+
     Int default_value_;
-    Int (*apply_)(Int, Int);
+    std::optional<Int> (*apply_)(Int, Int);
+    BigInt (*apply_big_)(const BigInt&, const BigInt&);
 };
 
+template <>
+struct TypeRange<IsMonotonic> : TypeRangeOf<ObjectType::IsMonotonic> {};
+template <>
+struct TypeRange<IntOperations> : TypeRangeOf<ObjectType::IntOperations> {};
+
+// apply gets only fixnums, so its result can't overflow Int.
 struct IntSoloArgumentOperation : public Function {
-    IntSoloArgumentOperation(Int (*apply)(Int), std::string function_name);
+    IntSoloArgumentOperation(Int (*apply)(Int), BigInt (*apply_big)(const BigInt&),
+                             std::string function_name);
     Object* Apply(const ArgsType& arguments) override;
 
 private:
     Int (*apply_)(Int);
-};
-
-struct Quote : public Function {
-    Quote();
-    Object* Apply(const ArgsType& arguments) override;
+    BigInt (*apply_big_)(const BigInt&);
 };
 
 struct IsBoolean : public Function {
@@ -98,16 +123,6 @@ struct Not : public Function {
     Object* Apply(const ArgsType& arguments) override;
 };
 
-struct And : public Function {
-    And();
-    Object* Apply(const ArgsType& arguments) override;
-};
-
-struct Or : public Function {
-    Or();
-    Object* Apply(const ArgsType& arguments) override;
-};
-
 struct IsPair : public Function {
     IsPair();
     Object* Apply(const ArgsType& arguments) override;
@@ -158,33 +173,125 @@ struct IsSymbol : public Function {
     Object* Apply(const ArgsType& arguments) override;
 };
 
-struct If : public Function {
-    If();
+struct SetCar : public Function {
+    SetCar();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct SetCdr : public Function {
+    SetCdr();
     Object* Apply(const ArgsType& arguments) override;
 };
 
-struct Define : public Function {
-    Define();
+struct MakeVector : public Function {
+    // 2^28 elements (2 GiB of pointers), a larger request is surely a mistake
+    static constexpr size_t kMaxSize = size_t{1} << 28;
+
+    MakeVector();
     Object* Apply(const ArgsType& arguments) override;
 };
 
-struct Set : public Function {
-    Set();
+struct VectorOf : public Function {
+    VectorOf();
     Object* Apply(const ArgsType& arguments) override;
 };
 
-struct SetCar : public Function {
-    SetCar();
+struct VectorRef : public Function {
+    VectorRef();
     Object* Apply(const ArgsType& arguments) override;
 };
 
-struct SetCdr : public Function {
-    SetCdr();
+struct VectorSet : public Function {
+    VectorSet();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct VectorLength : public Function {
+    VectorLength();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct VectorFill : public Function {
+    VectorFill();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct ListToVector : public Function {
+    ListToVector();
     Object* Apply(const ArgsType& arguments) override;
 };
 
-struct LambdaFunction : public Function {
-    inline static size_t free_index;
-    LambdaFunction();
+struct VectorToList : public Function {
+    VectorToList();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct IsString : public Function {
+    IsString();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct StringAppend : public Function {
+    StringAppend();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct Substring : public Function {
+    Substring();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct StringLength : public Function {
+    StringLength();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct StringEquals : public Function {
+    StringEquals();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct StringToSymbol : public Function {
+    StringToSymbol();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+struct SymbolToString : public Function {
+    SymbolToString();
+    Object* Apply(const ArgsType& arguments) override;
+};
+
+// Caches results of a function without side effects in a bounded table, evicting the least
+// recently used ones. Pairs and vectors could be changed later, so calls with them as arguments
+// are not cached.
+struct Memoized : public Function {
+    Memoized(Object* function, size_t capacity);
+    Object* Apply(const ArgsType& arguments) override;
+    void Trace(std::vector<Object*>* edges) const override;
+
+private:
+    using Key = std::vector<Object*>;
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    struct KeyEqual {
+        bool operator()(const Key& lhs, const Key& rhs) const;
+    };
+    // most recently used first
+    using Entries = std::list<std::pair<Key, Object*>>;
+
+    Object* function_;
+    size_t capacity_;
+    Entries entries_;
+    std::unordered_map<Key, Entries::iterator, KeyHash, KeyEqual> index_;
+};
+
+template <>
+struct TypeRange<Memoized> : TypeRangeOf<ObjectType::Memoized> {};
+
+struct Memoize : public Function {
+    static constexpr size_t kDefaultCapacity = 10000;
+
+    Memoize();
     Object* Apply(const ArgsType& arguments) override;
 };
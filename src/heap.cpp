@@ -1,21 +1,54 @@
 #include "heap.h"
+#include <algorithm>
+#include <cstdint>
 #include <memory>
+#include <vector>
 #include "object.h"
 
-Heap::Heap() {
-    root_ = Make<Empty>();
-}
+Heap::Heap() = default;
 void Heap::AddRootDependency(Object* object) {
-    root_->AddDependency(object);
+    roots_.push_back(object);
 }
 void Heap::RemoveRootDependencty(Object* object) {
-    root_->RemoveDependency(object);
+    if (auto it = std::find(roots_.begin(), roots_.end(), object); it != roots_.end()) {
+        roots_.erase(it);
+    }
+}
+void Heap::AddRootProvider(RootProvider* provider) {
+    providers_.push_back(provider);
+}
+void Heap::RemoveRootProvider(RootProvider* provider) {
+    providers_.erase(std::remove(providers_.begin(), providers_.end(), provider),
+                     providers_.end());
+}
+Object* Heap::MakeCell(Object* first, Object* second) {
+    if (free_cells_ == nullptr) {
+        // only the new chunk has free cells, the others need not be scanned again
+        cons_chunks_.push_back(std::make_unique<ConsChunk>());
+        AddFreeCells(cons_chunks_.back().get());
+    }
+    auto cell = free_cells_;
+    free_cells_ = reinterpret_cast<Cell*>(cell->first_);
+    auto chunk = GetChunk(cell);
+    chunk->live[GetIndex(chunk, cell)] = true;
+    cell->first_ = first;
+    cell->second_ = second;
+    ++alloc_count;
+    ++allocated_since_collect_;
+    ++live_cells_;
+    return ConsToObject(cell);
 }
 void Heap::DeleteUnuse() {
     for (auto& obj : objects_) {
         obj->mark_bit_ = false;
     }
-    MarkDfs(root_);
+    std::vector<Object*> roots = roots_;
+    for (auto provider : providers_) {
+        provider->CollectRoots(&roots);
+    }
+    for (auto root : roots) {
+        MarkDfs(root);
+    }
     for (size_t i = 0; i < objects_.size();) {
         if (objects_[i]->mark_bit_ == true) {
             objects_[i]->mark_bit_ = false;
@@ -26,14 +59,64 @@ void Heap::DeleteUnuse() {
         ++dealloc_count;
         objects_.pop_back();
     }
+    live_cells_ = 0;
+    for (auto& chunk : cons_chunks_) {
+        dealloc_count += (chunk->live & ~chunk->marks).count();
+        chunk->live = chunk->marks;
+        chunk->marks.reset();
+        live_cells_ += chunk->live.count();
+    }
+    std::erase_if(cons_chunks_, [](const auto& chunk) { return chunk->live.none(); });
+    CollectFreeCells();
+    allocated_since_collect_ = 0;
+    collect_threshold_ = std::max(kMinCollectThreshold, objects_.size() + live_cells_);
+}
+size_t Heap::GetConsChunkCount() const {
+    return cons_chunks_.size();
+}
+Heap::ConsChunk* Heap::GetChunk(Cell* cell) {
+    return reinterpret_cast<ConsChunk*>(reinterpret_cast<uintptr_t>(cell) &
+                                        ~(kConsChunkSize - 1));
+}
+size_t Heap::GetIndex(ConsChunk* chunk, Cell* cell) {
+    return cell - chunk->cells;
+}
+void Heap::CollectFreeCells() {
+    free_cells_ = nullptr;
+    for (auto& chunk : cons_chunks_) {
+        AddFreeCells(chunk.get());
+    }
+}
+void Heap::AddFreeCells(ConsChunk* chunk) {
+    scanned_cells += ConsChunk::kCells;
+    for (size_t i = ConsChunk::kCells; i-- > 0;) {
+        if (!chunk->live[i]) {
+            chunk->cells[i].first_ = reinterpret_cast<Object*>(free_cells_);
+            free_cells_ = &chunk->cells[i];
+        }
+    }
 }
 void Heap::MarkDfs(Object* root) {
-    root->mark_bit_ = true;
-    for (auto& other : root->dependency_) {
-        if (other->mark_bit_ == true) {
+    std::vector<Object*> pending{root};
+    while (!pending.empty()) {
+        auto current = pending.back();
+        pending.pop_back();
+        if (IsCons(current)) {
+            auto cell = ObjectToCons(current);
+            auto chunk = GetChunk(cell);
+            auto index = GetIndex(chunk, cell);
+            if (!chunk->marks[index]) {
+                chunk->marks[index] = true;
+                pending.push_back(cell->first_);
+                pending.push_back(cell->second_);
+            }
+            continue;
+        }
+        if (!IsHeapObject(current) || current->mark_bit_ == true) {
             continue;
         }
-        MarkDfs(other);
+        current->mark_bit_ = true;
+        current->Trace(&pending);
     }
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <bitset>
+#include <cstddef>
 #include <memory>
 #include <type_traits>
 #include <utility>
@@ -7,6 +9,13 @@
 
 #include "object.h"
 
+// Holds objects alive from outside of the object graph, e.g. the stack of an evaluator.
+class RootProvider {
+public:
+    virtual void CollectRoots(std::vector<Object*>* roots) const = 0;
+    virtual ~RootProvider() = default;
+};
+
 class Heap {
 private:
     Heap();
@@ -14,24 +23,68 @@ private:
 public:
     inline static int alloc_count;
     inline static int dealloc_count;
+    // cells visited while building the free list of pairs
+    inline static size_t scanned_cells;
     template <class ObjectType, typename... Args>
     requires std::is_base_of_v<Object, ObjectType> ObjectType* Make(Args&&... args) {
         auto current = new ObjectType(std::forward<Args>(args)...);
         ++alloc_count;
+        ++allocated_since_collect_;
         objects_.push_back(std::unique_ptr<Object>(current));
         return current;
     }
+    // A new pair, see Cell.
+    Object* MakeCell(Object* first, Object* second);
     void AddRootDependency(Object* object);
     void RemoveRootDependencty(Object* object);
+    void AddRootProvider(RootProvider* provider);
+    void RemoveRootProvider(RootProvider* provider);
     void DeleteUnuse();
+    size_t GetConsChunkCount() const;
+    static constexpr size_t GetCellsPerChunk() {
+        return ConsChunk::kCells;
+    }
+
+    // Evaluators call it at their safe points, where every live object is reachable
+    // from the root or from some RootProvider.
+    bool ShouldCollect() const {
+        return allocated_since_collect_ >= collect_threshold_;
+    }
 
 private:
     friend Heap* GetHeap();
 
+    static constexpr size_t kMinCollectThreshold = 1 << 16;
+
+    // The cons space is made of aligned chunks, so the chunk of a cell is found by its address.
+    // Bits of the chunk header tell the cells in use and the ones marked by the collector.
+    static constexpr size_t kConsChunkSize = 1 << 16;
+    struct alignas(kConsChunkSize) ConsChunk {
+        static constexpr size_t kCells = kConsChunkSize / sizeof(Cell) - 64;
+
+        std::bitset<kCells> live;
+        std::bitset<kCells> marks;
+        Cell cells[kCells];
+    };
+    static_assert(sizeof(ConsChunk) == kConsChunkSize);
+
+    static ConsChunk* GetChunk(Cell* cell);
+    static size_t GetIndex(ConsChunk* chunk, Cell* cell);
     static void MarkDfs(Object* root);
+    // Puts every cell that is not in use on free_cells_, linked through their first field.
+    void CollectFreeCells();
+    // Same for the cells of one chunk, they are put in front of the list.
+    void AddFreeCells(ConsChunk* chunk);
 
     std::vector<std::unique_ptr<Object>> objects_;
-    Object* root_;
+    std::vector<std::unique_ptr<ConsChunk>> cons_chunks_;
+    Cell* free_cells_ = nullptr;
+    size_t live_cells_ = 0;
+    std::vector<RootProvider*> providers_;
+    // objects kept alive by AddRootDependency
+    std::vector<Object*> roots_;
+    size_t allocated_since_collect_ = 0;
+    size_t collect_threshold_ = kMinCollectThreshold;
 };
 
 Heap* GetHeap();
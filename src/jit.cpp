@@ -0,0 +1,717 @@
+#include "jit.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bytecode.h"
+#include "functions.h"
+#include "heap.h"
+#include "vm.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define SCHEME_NATIVE_X86_64
+#endif
+
+static auto heap = GetHeap();
+
+NativeCode::NativeCode(void* memory, size_t size, size_t max_depth)
+    : memory_(memory), size_(size), max_depth_(max_depth) {
+}
+
+NativeCode::~NativeCode() {
+#ifdef SCHEME_NATIVE_X86_64
+    munmap(memory_, size_);
+#endif
+}
+
+NativeCode::Exit NativeCode::Run(VirtualMachine* vm, Object** locals, Object** top,
+                                 size_t pc) const {
+    return reinterpret_cast<Entry>(memory_)(vm, locals, top, pc);
+}
+
+size_t NativeCode::GetMaxDepth() const {
+    return max_depth_;
+}
+
+#ifndef SCHEME_NATIVE_X86_64
+
+std::unique_ptr<NativeCode> CompileNative(Prototype*) {
+    return nullptr;
+}
+
+#else
+
+namespace {
+
+enum Register : uint8_t {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RBX = 3,
+    RSP = 4,
+    RBP = 5,
+    RSI = 6,
+    RDI = 7,
+    R12 = 12,
+    R13 = 13,
+};
+
+enum Condition : uint8_t {
+    Overflow = 0x0,
+    AboveEqual = 0x3,
+    Equal = 0x4,
+    NotEqual = 0x5,
+    Less = 0xC,
+    GreaterEqual = 0xD,
+    LessEqual = 0xE,
+    Greater = 0xF,
+};
+
+// Encodes the few x86-64 instructions the templates use. Memory operands are [base + disp32].
+class Assembler {
+public:
+    using Label = size_t;
+
+    Label NewLabel() {
+        labels_.push_back(kUnbound);
+        return labels_.size() - 1;
+    }
+    void Bind(Label label) {
+        labels_[label] = code_.size();
+    }
+    size_t GetPosition(Label label) const {
+        return labels_[label];
+    }
+
+    void Push(Register reg) {
+        Rex(false, 0, reg);
+        Byte(0x50 + (reg & 7));
+    }
+    void Pop(Register reg) {
+        Rex(false, 0, reg);
+        Byte(0x58 + (reg & 7));
+    }
+    void Return() {
+        Byte(0xC3);
+    }
+    void Move(Register dst, Register src) {
+        Rex(true, src, dst);
+        Byte(0x89);
+        ModRm(3, src, dst);
+    }
+    void MoveImmediate(Register dst, uint64_t value) {
+        Rex(true, 0, dst);
+        Byte(0xB8 + (dst & 7));
+        Bytes(&value, sizeof(value));
+    }
+    void MoveImmediate32(Register dst, uint32_t value) {
+        Rex(false, 0, dst);
+        Byte(0xB8 + (dst & 7));
+        Bytes(&value, sizeof(value));
+    }
+    void Load(Register dst, Register base, int32_t disp) {
+        Rex(true, dst, base);
+        Byte(0x8B);
+        Memory(dst, base, disp);
+    }
+    void Store(Register base, int32_t disp, Register src) {
+        Rex(true, src, base);
+        Byte(0x89);
+        Memory(src, base, disp);
+    }
+    void StoreImmediate(Register base, int32_t disp, int32_t value) {
+        Rex(true, 0, base);
+        Byte(0xC7);
+        Memory(0, base, disp);
+        Bytes(&value, sizeof(value));
+    }
+    void AddImmediate(Register dst, int32_t value) {
+        Rex(true, 0, dst);
+        Byte(0x81);
+        ModRm(3, 0, dst);
+        Bytes(&value, sizeof(value));
+    }
+    void CompareImmediate(Register reg, int32_t value) {
+        Rex(true, 0, reg);
+        Byte(0x81);
+        ModRm(3, 7, reg);
+        Bytes(&value, sizeof(value));
+    }
+    void Add(Register dst, Register src) {
+        Rex(true, src, dst);
+        Byte(0x01);
+        ModRm(3, src, dst);
+    }
+    void Subtract(Register dst, Register src) {
+        Rex(true, src, dst);
+        Byte(0x29);
+        ModRm(3, src, dst);
+    }
+    void And(Register dst, Register src) {
+        Rex(true, src, dst);
+        Byte(0x21);
+        ModRm(3, src, dst);
+    }
+    void ShiftRightArithmetic(Register reg, uint8_t count) {
+        Rex(true, 0, reg);
+        Byte(0xC1);
+        ModRm(3, 7, reg);
+        Byte(count);
+    }
+    void Multiply(Register dst, Register src) {
+        Rex(true, dst, src);
+        Byte(0x0F);
+        Byte(0xAF);
+        ModRm(3, dst, src);
+    }
+    // flags of left - right
+    void Compare(Register left, Register right) {
+        Rex(true, right, left);
+        Byte(0x39);
+        ModRm(3, right, left);
+    }
+    void CompareMemory(Register left, Register base, int32_t disp) {
+        Rex(true, left, base);
+        Byte(0x3B);
+        Memory(left, base, disp);
+    }
+    void Test(Register left, Register right) {
+        Rex(true, right, left);
+        Byte(0x85);
+        ModRm(3, right, left);
+    }
+    void TestImmediate(Register reg, int32_t value) {
+        Rex(true, 0, reg);
+        Byte(0xF7);
+        ModRm(3, 0, reg);
+        Bytes(&value, sizeof(value));
+    }
+    // test al, al
+    void TestByte() {
+        Byte(0x84);
+        Byte(0xC0);
+    }
+    void Call(Register target) {
+        Rex(false, 0, target);
+        Byte(0xFF);
+        ModRm(3, 2, target);
+    }
+    void JumpTo(Register target) {
+        Rex(false, 0, target);
+        Byte(0xFF);
+        ModRm(3, 4, target);
+    }
+    void Jump(Label label) {
+        Byte(0xE9);
+        Relative(label);
+    }
+    void JumpIf(Condition condition, Label label) {
+        Byte(0x0F);
+        Byte(0x80 | condition);
+        Relative(label);
+    }
+    // lea dst, [rip + label]
+    void LoadAddress(Register dst, Label label) {
+        Rex(true, dst, RBP);
+        Byte(0x8D);
+        ModRm(0, dst, RBP);
+        Relative(label);
+    }
+    // movsxd rcx, dword [rax + rcx * 4]
+    void LoadTableEntry() {
+        for (uint8_t byte : {0x48, 0x63, 0x0C, 0x88}) {
+            Byte(byte);
+        }
+    }
+    void Int32(int32_t value) {
+        Bytes(&value, sizeof(value));
+    }
+    void Align(size_t alignment) {
+        while (code_.size() % alignment != 0) {
+            Byte(0xCC);
+        }
+    }
+
+    // Resolves the jumps, all their labels have to be bound.
+    const std::vector<uint8_t>& Finish() {
+        for (auto [position, label] : fixups_) {
+            int32_t offset = static_cast<int32_t>(labels_[label] - (position + 4));
+            std::memcpy(code_.data() + position, &offset, sizeof(offset));
+        }
+        fixups_.clear();
+        return code_;
+    }
+
+private:
+    static constexpr size_t kUnbound = static_cast<size_t>(-1);
+
+    void Byte(uint8_t byte) {
+        code_.push_back(byte);
+    }
+    void Bytes(const void* data, size_t size) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        code_.insert(code_.end(), bytes, bytes + size);
+    }
+    void Rex(bool wide, uint8_t reg, uint8_t base) {
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0);
+        if (rex != 0x40) {
+            Byte(rex);
+        }
+    }
+    void ModRm(uint8_t mod, uint8_t reg, uint8_t rm) {
+        Byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+    }
+    void Memory(uint8_t reg, Register base, int32_t disp) {
+        ModRm(2, reg, base);
+        if ((base & 7) == RSP) {
+            Byte(0x24);
+        }
+        Int32(disp);
+    }
+    void Relative(Label label) {
+        fixups_.push_back({code_.size(), label});
+        Int32(0);
+    }
+
+    std::vector<uint8_t> code_;
+    std::vector<size_t> labels_;
+    std::vector<std::pair<size_t, Label>> fixups_;
+};
+
+bool ShouldCollect() {
+    return heap->ShouldCollect();
+}
+
+}  // namespace
+
+// Translates every instruction with a fixed template. The registers hold:
+// rbx the VM, r12 the top of the stack, r13 the locals of the frame.
+// Instructions without a template, and the slow paths of the others, exit to the interpreter.
+class NativeCompiler {
+public:
+    explicit NativeCompiler(Prototype* prototype) : prototype_(prototype) {
+    }
+
+    std::unique_ptr<NativeCode> Compile() {
+        auto& code = prototype_->code;
+        Analyze();
+        for (size_t pc = 0; pc < code.size(); ++pc) {
+            labels_.push_back(assembler_.NewLabel());
+        }
+        exits_.assign(code.size(), kNoExit);
+        auto epilogue = assembler_.NewLabel();
+        auto table = assembler_.NewLabel();
+        auto exit_with_pc = assembler_.NewLabel();
+
+        // Exit Entry(VirtualMachine* vm, Object** locals, Object** top, uint64_t pc)
+        assembler_.Push(RBX);
+        assembler_.Push(R12);
+        assembler_.Push(R13);
+        assembler_.Move(RBX, RDI);
+        assembler_.Move(R13, RSI);
+        assembler_.Move(R12, RDX);
+        assembler_.CompareImmediate(RCX, static_cast<int32_t>(code.size()));
+        assembler_.JumpIf(AboveEqual, exit_with_pc);
+        assembler_.LoadAddress(RAX, table);
+        assembler_.LoadTableEntry();
+        assembler_.Add(RAX, RCX);
+        assembler_.JumpTo(RAX);
+        assembler_.Bind(exit_with_pc);
+        assembler_.Move(RDX, RCX);
+        assembler_.Bind(epilogue);
+        assembler_.Move(RAX, R12);
+        assembler_.Pop(R13);
+        assembler_.Pop(R12);
+        assembler_.Pop(RBX);
+        assembler_.Return();
+        epilogue_ = epilogue;
+
+        for (size_t pc = 0; pc < code.size(); ++pc) {
+            assembler_.Bind(labels_[pc]);
+            if (!states_[pc].reachable) {
+                EmitExit(pc);
+                continue;
+            }
+            EmitInstruction(pc);
+        }
+        for (size_t pc = 0; pc < code.size(); ++pc) {
+            if (exits_[pc] != kNoExit) {
+                assembler_.Bind(exits_[pc]);
+                EmitExit(pc);
+            }
+        }
+        assembler_.Align(4);
+        assembler_.Bind(table);
+        for (size_t pc = 0; pc < code.size(); ++pc) {
+            assembler_.Int32(static_cast<int32_t>(assembler_.GetPosition(labels_[pc]) -
+                                                  assembler_.GetPosition(table)));
+        }
+        return Install(assembler_.Finish());
+    }
+
+private:
+    static constexpr size_t kNoExit = static_cast<size_t>(-1);
+    static constexpr int64_t kUnknown = -1;
+    static constexpr int32_t kSlot = sizeof(Object*);
+
+    // Stack above the locals before an instruction: the pc, that pushed each value.
+    struct State {
+        bool reachable = false;
+        std::vector<int64_t> producers;
+    };
+
+    // Instructions are visited again, while the states flowing into them change. A state only
+    // loses producers, so the loops of the code are analyzed in a few passes.
+    void Analyze() {
+        auto& code = prototype_->code;
+        states_.assign(code.size() + 1, State{});
+        states_[0].reachable = true;
+        pending_.push_back(0);
+        while (!pending_.empty()) {
+            auto pc = pending_.back();
+            pending_.pop_back();
+            if (pc >= code.size()) {
+                continue;
+            }
+            auto state = states_[pc].producers;
+            max_depth_ = std::max(max_depth_, state.size() + 1);
+            auto instruction = code[pc];
+            switch (instruction.code) {
+                case OpCode::Constant:
+                case OpCode::Nil:
+                case OpCode::LoadLocal:
+                case OpCode::LoadLocalChecked:
+                case OpCode::LoadBoxed:
+                case OpCode::LoadCapture:
+                case OpCode::LoadCaptureBoxed:
+                case OpCode::LoadGlobal:
+                case OpCode::MakeClosure:
+                    state.push_back(pc);
+                    Flow(pc + 1, state);
+                    break;
+                case OpCode::DefineLocal:
+                case OpCode::DefineBoxed:
+                case OpCode::SetLocal:
+                case OpCode::SetBoxed:
+                case OpCode::SetCaptureBoxed:
+                case OpCode::DefineGlobal:
+                case OpCode::SetGlobal:
+                    state.back() = kUnknown;
+                    Flow(pc + 1, state);
+                    break;
+                case OpCode::Pop:
+                case OpCode::StoreLocal:
+                    state.pop_back();
+                    Flow(pc + 1, state);
+                    break;
+                case OpCode::ClearLocal:
+                    Flow(pc + 1, state);
+                    break;
+                case OpCode::Jump:
+                case OpCode::Loop:
+                    Flow(instruction.arg, state);
+                    break;
+                case OpCode::JumpIfFalse:
+                    state.pop_back();
+                    Flow(instruction.arg, state);
+                    Flow(pc + 1, state);
+                    break;
+                case OpCode::JumpIfFalseOr:
+                case OpCode::JumpIfTrueOr:
+                    Flow(instruction.arg, state);
+                    state.pop_back();
+                    Flow(pc + 1, state);
+                    break;
+                case OpCode::Folded:
+                    Flow(pc + 2, state);
+                    state.push_back(pc);
+                    Flow(pc + 1, state);
+                    break;
+                case OpCode::Call:
+                case OpCode::TailCall:
+                    state.resize(state.size() - instruction.arg - 1);
+                    state.push_back(pc);
+                    Flow(pc + 1, state);
+                    break;
+                case OpCode::ImproperCall:
+                case OpCode::Return:
+                    break;
+            }
+        }
+    }
+
+    void Flow(size_t pc, const std::vector<int64_t>& producers) {
+        auto& state = states_[pc];
+        if (!state.reachable) {
+            state.reachable = true;
+            state.producers = producers;
+            pending_.push_back(pc);
+            return;
+        }
+        bool changed = false;
+        for (size_t i = 0; i < producers.size(); ++i) {
+            if (state.producers[i] != producers[i] && state.producers[i] != kUnknown) {
+                state.producers[i] = kUnknown;
+                changed = true;
+            }
+        }
+        if (changed) {
+            pending_.push_back(pc);
+        }
+    }
+
+    void EmitInstruction(size_t pc) {
+        auto instruction = prototype_->code[pc];
+        switch (instruction.code) {
+            case OpCode::Constant:
+                assembler_.MoveImmediate(
+                    RAX, reinterpret_cast<uint64_t>(prototype_->GetConstants()[instruction.arg]));
+                EmitPush(RAX);
+                break;
+            case OpCode::Nil:
+                assembler_.StoreImmediate(R12, 0, 0);
+                assembler_.AddImmediate(R12, kSlot);
+                break;
+            case OpCode::LoadLocal:
+                assembler_.Load(RAX, R13, instruction.arg * kSlot);
+                EmitPush(RAX);
+                break;
+            case OpCode::LoadLocalChecked:
+                assembler_.Load(RAX, R13, instruction.arg * kSlot);
+                EmitBoundCheck(pc);
+                EmitPush(RAX);
+                break;
+            case OpCode::LoadGlobal:
+                assembler_.MoveImmediate(
+                    RAX, reinterpret_cast<uint64_t>(&prototype_->bindings[instruction.arg]->value));
+                assembler_.Load(RAX, RAX, 0);
+                EmitBoundCheck(pc);
+                EmitPush(RAX);
+                break;
+            case OpCode::Pop:
+                assembler_.AddImmediate(R12, -kSlot);
+                break;
+            case OpCode::StoreLocal:
+                assembler_.Load(RAX, R12, -kSlot);
+                assembler_.AddImmediate(R12, -kSlot);
+                assembler_.Store(R13, instruction.arg * kSlot, RAX);
+                break;
+            case OpCode::Jump:
+                assembler_.Jump(labels_[instruction.arg]);
+                break;
+            case OpCode::Loop:
+                // the interpreter collects garbage at the loop instruction
+                EmitCall(reinterpret_cast<void*>(&ShouldCollect));
+                assembler_.TestByte();
+                assembler_.JumpIf(NotEqual, GetExit(pc));
+                assembler_.Jump(labels_[instruction.arg]);
+                break;
+            case OpCode::JumpIfFalse:
+                assembler_.Load(RAX, R12, -kSlot);
+                assembler_.AddImmediate(R12, -kSlot);
+                EmitCompareWithFalse(RAX);
+                assembler_.JumpIf(Equal, labels_[instruction.arg]);
+                break;
+            case OpCode::JumpIfFalseOr:
+            case OpCode::JumpIfTrueOr:
+                assembler_.Load(RAX, R12, -kSlot);
+                EmitCompareWithFalse(RAX);
+                assembler_.JumpIf(instruction.code == OpCode::JumpIfFalseOr ? Equal : NotEqual,
+                                  labels_[instruction.arg]);
+                assembler_.AddImmediate(R12, -kSlot);
+                break;
+            case OpCode::Folded:
+                // the step pushes the value only if the fold holds
+                EmitStep(pc);
+                assembler_.Compare(RAX, R12);
+                assembler_.JumpIf(Equal, labels_[pc + 2]);
+                assembler_.Move(R12, RAX);
+                break;
+            case OpCode::LoadBoxed:
+            case OpCode::DefineLocal:
+            case OpCode::DefineBoxed:
+            case OpCode::ClearLocal:
+            case OpCode::SetLocal:
+            case OpCode::SetBoxed:
+            case OpCode::LoadCapture:
+            case OpCode::LoadCaptureBoxed:
+            case OpCode::SetCaptureBoxed:
+            case OpCode::DefineGlobal:
+            case OpCode::SetGlobal:
+            case OpCode::MakeClosure:
+                EmitStep(pc);
+                assembler_.Test(RAX, RAX);
+                assembler_.JumpIf(Equal, GetExit(pc));
+                assembler_.Move(R12, RAX);
+                break;
+            case OpCode::Call:
+            case OpCode::TailCall:
+                if (!EmitFixnumCall(pc)) {
+                    EmitExit(pc);
+                }
+                break;
+            case OpCode::ImproperCall:
+            case OpCode::Return:
+                EmitExit(pc);
+                break;
+        }
+    }
+
+    // A call of a global bound to a numeric builtin with two arguments computes it inline,
+    // while the callee is still the same builtin and both arguments are fixnums.
+    bool EmitFixnumCall(size_t pc) {
+        auto instruction = prototype_->code[pc];
+        auto& producers = states_[pc].producers;
+        if (instruction.arg != 2 || producers.size() < 3 || producers[producers.size() - 3] < 0) {
+            return false;
+        }
+        auto load = prototype_->code[producers[producers.size() - 3]];
+        if (load.code != OpCode::LoadGlobal) {
+            return false;
+        }
+        auto callee = prototype_->bindings[load.arg]->value;
+        if (!Is<Function>(callee)) {
+            return false;
+        }
+        auto name = As<Function>(callee)->GetName();
+        bool operation = Is<IntOperations>(callee) && (name == "+" || name == "-" || name == "*");
+        bool comparison = Is<IsMonotonic>(callee) && (name == "=" || name == "<" || name == ">" ||
+                                                      name == "<=" || name == ">=");
+        if (!operation && !comparison) {
+            return false;
+        }
+
+        auto exit = GetExit(pc);
+        assembler_.Load(RAX, R12, -3 * kSlot);
+        assembler_.MoveImmediate(RCX, reinterpret_cast<uint64_t>(callee));
+        assembler_.Compare(RAX, RCX);
+        assembler_.JumpIf(NotEqual, exit);
+        assembler_.Load(RDI, R12, -2 * kSlot);
+        assembler_.Load(RSI, R12, -kSlot);
+        // both are fixnums, when both tag bits are set
+        assembler_.Move(RAX, RDI);
+        assembler_.And(RAX, RSI);
+        assembler_.TestImmediate(RAX, 1);
+        assembler_.JumpIf(Equal, exit);
+        if (operation) {
+            // computed on the tagged values, a result out of the fixnum range overflows
+            // and is left to the interpreter
+            if (name == "+") {
+                assembler_.AddImmediate(RDI, -1);
+                assembler_.Add(RDI, RSI);
+                assembler_.JumpIf(Overflow, exit);
+            } else if (name == "-") {
+                assembler_.Subtract(RDI, RSI);
+                assembler_.JumpIf(Overflow, exit);
+                assembler_.AddImmediate(RDI, 1);
+            } else {
+                assembler_.ShiftRightArithmetic(RDI, 1);
+                assembler_.AddImmediate(RSI, -1);
+                assembler_.Multiply(RDI, RSI);
+                assembler_.JumpIf(Overflow, exit);
+                assembler_.AddImmediate(RDI, 1);
+            }
+            assembler_.Move(RAX, RDI);
+        } else {
+            assembler_.Compare(RDI, RSI);
+            Condition condition = Equal;
+            if (name == "<") {
+                condition = Less;
+            } else if (name == ">") {
+                condition = Greater;
+            } else if (name == "<=") {
+                condition = LessEqual;
+            } else if (name == ">=") {
+                condition = GreaterEqual;
+            }
+            auto done = assembler_.NewLabel();
+            assembler_.MoveImmediate(RAX, reinterpret_cast<uint64_t>(Boolean(true)));
+            assembler_.JumpIf(condition, done);
+            assembler_.MoveImmediate(RAX, reinterpret_cast<uint64_t>(Boolean(false)));
+            assembler_.Bind(done);
+        }
+        assembler_.Store(R12, -3 * kSlot, RAX);
+        assembler_.AddImmediate(R12, -2 * kSlot);
+        return true;
+    }
+
+    void EmitPush(Register value) {
+        assembler_.Store(R12, 0, value);
+        assembler_.AddImmediate(R12, kSlot);
+    }
+
+    // #f is the only false value, so a truth test is a pointer comparison
+    void EmitCompareWithFalse(Register value) {
+        assembler_.MoveImmediate(RCX, reinterpret_cast<uint64_t>(Boolean(false)));
+        assembler_.Compare(value, RCX);
+    }
+
+    // reads of unbound variables fail in the interpreter
+    void EmitBoundCheck(size_t pc) {
+        assembler_.MoveImmediate(RCX, reinterpret_cast<uint64_t>(Unbound()));
+        assembler_.Compare(RAX, RCX);
+        assembler_.JumpIf(Equal, GetExit(pc));
+    }
+
+    void EmitCall(void* function) {
+        assembler_.MoveImmediate(RAX, reinterpret_cast<uint64_t>(function));
+        assembler_.Call(RAX);
+    }
+
+    // rax = VirtualMachine::NativeStep(vm, top, pc)
+    void EmitStep(size_t pc) {
+        assembler_.Move(RDI, RBX);
+        assembler_.Move(RSI, R12);
+        assembler_.MoveImmediate32(RDX, pc);
+        EmitCall(reinterpret_cast<void*>(&VirtualMachine::NativeStep));
+    }
+
+    // returns {top, pc}, so the interpreter executes the instruction at pc
+    void EmitExit(size_t pc) {
+        assembler_.MoveImmediate32(RDX, pc);
+        assembler_.Jump(epilogue_);
+    }
+
+    Assembler::Label GetExit(size_t pc) {
+        if (exits_[pc] == kNoExit) {
+            exits_[pc] = assembler_.NewLabel();
+        }
+        return exits_[pc];
+    }
+
+    std::unique_ptr<NativeCode> Install(const std::vector<uint8_t>& code) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t size = (code.size() + page - 1) / page * page;
+        void* memory =
+            mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return nullptr;
+        }
+        std::memcpy(memory, code.data(), code.size());
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            return nullptr;
+        }
+        return std::make_unique<NativeCode>(memory, size, max_depth_);
+    }
+
+    Prototype* prototype_;
+    Assembler assembler_;
+    std::vector<State> states_;
+    std::vector<size_t> pending_;
+    std::vector<Assembler::Label> labels_;
+    std::vector<Assembler::Label> exits_;
+    Assembler::Label epilogue_ = 0;
+    size_t max_depth_ = 0;
+};
+
+std::unique_ptr<NativeCode> CompileNative(Prototype* prototype) {
+    return NativeCompiler(prototype).Compile();
+}
+
+#endif
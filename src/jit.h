@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "object.h"
+
+struct Prototype;
+class VirtualMachine;
+
+// Machine code for the instructions of one prototype. It runs a frame from the given pc and
+// stops before the first instruction it leaves to the interpreter: calls of closures, returns,
+// failures and missed fast paths. The interpreter executes that instruction and then resumes
+// the native code after it.
+class NativeCode {
+public:
+    struct Exit {
+        Object** top;
+        uint64_t pc;
+    };
+    using Entry = Exit (*)(VirtualMachine* vm, Object** locals, Object** top, uint64_t pc);
+
+    NativeCode(void* memory, size_t size, size_t max_depth);
+    NativeCode(const NativeCode&) = delete;
+    NativeCode& operator=(const NativeCode&) = delete;
+    ~NativeCode();
+
+    Exit Run(VirtualMachine* vm, Object** locals, Object** top, size_t pc) const;
+    // values the code could push above the locals
+    size_t GetMaxDepth() const;
+
+private:
+    void* memory_;
+    size_t size_;
+    size_t max_depth_;
+};
+
+// nullptr where native code is not supported
+std::unique_ptr<NativeCode> CompileNative(Prototype* prototype);
@@ -1,30 +1,22 @@
 #include "object.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <stdexcept>
 #include <string>
-#include <typeinfo>
+#include <utility>
 
+#include "ast.h"
+#include "error.h"
 #include "heap.h"
 
-Object::Object() : mark_bit_(false) {
+Object::Object(ObjectType type) : type_(type), mark_bit_(false) {
 }
-void Object::AddDependency(Object* other) {
-    if (other == nullptr) {
-        return;
-    }
-    dependency_.insert(other);
-}
-void Object::RemoveDependency(Object* other) {
-    if (other == nullptr) {
-        return;
-    }
-    if (dependency_.find(other) == dependency_.end()) {
-        return;
-    }
-    dependency_.erase(dependency_.find(other));
+void Object::Trace(std::vector<Object*>*) const {
 }
 
+Empty::Empty() : Object(ObjectType::Empty) {
+}
 Object* Empty::Copy() const {
     static auto heap = GetHeap();
     return heap->Make<Empty>();
@@ -33,10 +25,9 @@ std::string Empty::ToString() const {
     return "";
 }
 
-Number::Number(Int value) {
-    value_ = value;
+Number::Number(BigInt value) : Object(ObjectType::Number), value_(std::move(value)) {
 }
-Int Number::GetValue() const {
+const BigInt& Number::GetValue() const {
     return value_;
 }
 Object* Number::Copy() const {
@@ -44,117 +35,131 @@ Object* Number::Copy() const {
     return heap->Make<Number>(value_);
 }
 std::string Number::ToString() const {
-    return std::to_string(value_);
+    return value_.ToString();
 }
 
-Symbol::Symbol(const std::string& symbol) {
-    symbol_ = symbol;
-}
-const std::string& Symbol::GetName() const {
-    return symbol_;
+Object* MakeNumber(Int value) {
+    static auto heap = GetHeap();
+    if (value < kFixnumMin || value > kFixnumMax) {
+        return heap->Make<Number>(BigInt(value));
+    }
+    return reinterpret_cast<Object*>((static_cast<uintptr_t>(value) << 1) | 1);
 }
-Object* Symbol::Copy() const {
+
+Object* MakeNumber(const BigInt& value) {
     static auto heap = GetHeap();
-    return heap->Make<Symbol>(symbol_);
+    auto small = value.ToInt();
+    if (!small || *small < kFixnumMin || *small > kFixnumMax) {
+        return heap->Make<Number>(value);
+    }
+    return MakeNumber(*small);
 }
-std::string Symbol::ToString() const {
-    return symbol_;
+
+Int GetNumberValue(Object* number) {
+    if (IsFixnum(number)) {
+        return GetFixnumValue(number);
+    }
+    auto value = static_cast<Number*>(number)->GetValue().ToInt();
+    if (!value) {
+        throw RuntimeError("number is too big");
+    }
+    return *value;
 }
 
-Cell::Cell(Object* first, Object* second) {
-    AddDependency(first);
-    AddDependency(second);
-    first_ = first;
-    second_ = second;
+BigInt GetBigValue(Object* number) {
+    if (IsFixnum(number)) {
+        return BigInt(GetFixnumValue(number));
+    }
+    return static_cast<Number*>(number)->GetValue();
 }
-Object* Cell::GetFirst() const {
-    return first_;
+
+std::string ObjectToString(Object* object) {
+    if (IsFixnum(object)) {
+        return std::to_string(GetFixnumValue(object));
+    }
+    if (IsCons(object)) {
+        return As<Cell>(object)->ToString();
+    }
+    return object->ToString();
 }
-Object* Cell::GetSecond() const {
-    return second_;
+
+Symbol::Symbol(SymbolId id) : Object(ObjectType::Symbol), id_(id) {
 }
-void Cell::SetFirst(Object* first) {
-    RemoveDependency(first_);
-    first_ = first;
-    AddDependency(first_);
+SymbolId Symbol::GetId() const {
+    return id_;
 }
-void Cell::SetSecond(Object* second) {
-    RemoveDependency(second_);
-    second_ = second;
-    AddDependency(second_);
+const std::string& Symbol::GetName() const {
+    return GetSymbolName(id_);
 }
-Object* Cell::Copy() const {
+Object* Symbol::Copy() const {
+    return MakeSymbol(id_);
+}
+std::string Symbol::ToString() const {
+    return GetName();
+}
+
+Symbol* MakeSymbol(SymbolId id) {
     static auto heap = GetHeap();
-    Object* n_f = nullptr;
-    Object* n_s = nullptr;
-    if (first_ != nullptr) {
-        n_f = first_->Copy();
+    static std::vector<Symbol*> symbols;
+    if (id >= symbols.size()) {
+        symbols.resize(id + 1, nullptr);
     }
-    if (second_ != nullptr) {
-        n_s = second_->Copy();
+    if (symbols[id] == nullptr) {
+        symbols[id] = heap->Make<Symbol>(id);
+        heap->AddRootDependency(symbols[id]);
     }
-    return heap->Make<Cell>(n_f, n_s);
+    return symbols[id];
 }
+
 std::string Cell::ToString() const {
     return ToString(false);
 }
+// The spine of the list is walked in a loop, so long lists don't recurse.
 std::string Cell::ToString(bool in_list) const {
     std::string answer;
     if (!in_list) {
         answer += "(";
     }
-    if (first_ == nullptr) {
-        answer += "()";
-    } else if (Is<Cell>(first_)) {
-        answer += As<Cell>(first_)->ToString(false);
-    } else {
-        answer += first_->ToString();
-    }
-    if (second_ == nullptr) {
-        answer += ")";
-        return answer;
-    }
-    if (Is<Cell>(second_)) {
+    const Cell* current = this;
+    while (true) {
+        auto first = current->first_;
+        if (first == nullptr) {
+            answer += "()";
+        } else if (Is<Cell>(first)) {
+            answer += As<Cell>(first)->ToString(false);
+        } else {
+            answer += ObjectToString(first);
+        }
+        auto second = current->second_;
+        if (second == nullptr) {
+            answer += ")";
+            return answer;
+        }
+        if (!Is<Cell>(second)) {
+            answer += " . ";
+            answer += ObjectToString(second);
+            answer += ")";
+            return answer;
+        }
         answer += " ";
-        answer += As<Cell>(second_)->ToString(true);
-        return answer;
-    } else {
-        answer += " . ";
-        answer += second_->ToString();
-        answer += ")";
-        return answer;
+        current = As<Cell>(second);
     }
 }
 
+BasicFunction::BasicFunction(ObjectType type) : Object(type) {
+}
 Object* BasicFunction::Copy() const {
     throw std::runtime_error("basic function is not copyable");
 }
 
-Scope::Scope() {
+Scope::Scope() : Object(ObjectType::Scope) {
     previos_ = nullptr;
 }
-Scope::Scope(Scope* previos) {
+Scope::Scope(Scope* previos) : Object(ObjectType::Scope) {
     this->previos_ = previos;
 }
-void Scope::AddScope(const std::string& name, Scope* scope) {
-    if (scopes_.find(name) != scopes_.end()) {
-        RemoveDependency(scopes_[name]);
-    }
-    AddDependency(scope);
-    scopes_[name] = scope;
-}
-void Scope::AddValue(const std::string& name, Object* value) {
-    if (values_.find(name) != values_.end()) {
-        RemoveDependency(values_[name]);
-    }
-    AddDependency(value);
-    values_[name] = value;
-}
-void Scope::RemoveScope(const std::string& name) {
-    if (scopes_.find(name) != scopes_.end()) {
-        RemoveDependency(scopes_[name]);
-        scopes_.erase(name);
-    }
+void Scope::AddValue(SymbolId name, Object* value) {
+    SetValue(GetBinding(name), value);
 }
 Object* Scope::Copy() const {
     throw std::runtime_error("scope is not copyable");
@@ -163,59 +168,222 @@ std::string Scope::ToString() const {
     std::string ans = "<Scope (" + std::to_string(reinterpret_cast<std::uintptr_t>(this)) + "):\n";
     ans += "previos = " + std::to_string(reinterpret_cast<std::uintptr_t>(previos_)) + ",\n";
     ans += "values:\n";
-    for (auto [str, obj] : values_) {
+    for (auto& [name, binding] : bindings_) {
+        auto obj = binding.value;
+        if (obj == Unbound()) {
+            continue;
+        }
+        const auto& str = GetSymbolName(name);
         if (obj == nullptr) {
             ans += "\t" + str + "=()\n";
         } else {
-            ans += "\t" + str + "=" + obj->ToString() + "\n";
+            ans += "\t" + str + "=" + ObjectToString(obj) + "\n";
         }
     }
-    ans += "scopes:\n";
-    for (auto [str, sc] : scopes_) {
-        ans += "\t" + str + "=" + std::to_string(reinterpret_cast<std::uintptr_t>(sc)) + "\n";
-    }
     return ans;
 }
-const std::map<std::string, Scope*>& Scope::GetScopes() const {
-    return scopes_;
+Binding* Scope::GetBinding(SymbolId name) {
+    auto [it, _] = bindings_.try_emplace(name, Binding{.name = name, .value = Unbound()});
+    return &it->second;
 }
-const std::map<std::string, Object*>& Scope::GetValues() const {
-    return values_;
+Binding* Scope::FindBinding(SymbolId name) {
+    auto it = bindings_.find(name);
+    if (it == bindings_.end() || it->second.value == Unbound()) {
+        return nullptr;
+    }
+    return &it->second;
+}
+void Scope::SetValue(Binding* binding, Object* value) {
+    binding->value = value;
 }
 Scope* Scope::GetPrevios() const {
     return previos_;
 }
+// Bindings are kept, so the next call binding the same names does not allocate them.
+void Scope::Reset(Scope* previos) {
+    for (auto& [_, binding] : bindings_) {
+        binding.value = Unbound();
+    }
+    previos_ = previos;
+}
+void Scope::Trace(std::vector<Object*>* edges) const {
+    edges->push_back(previos_);
+    for (auto& [_, binding] : bindings_) {
+        edges->push_back(binding.value);
+    }
+}
 
+Lambda::Lambda(LambdaNode* code, Scope* scope)
+    : Object(ObjectType::Lambda), code_(code), my_scope_(scope) {
+}
+void Lambda::Trace(std::vector<Object*>* edges) const {
+    edges->push_back(code_);
+    edges->push_back(my_scope_);
+}
 Object* Lambda::Copy() const {
     static auto heap = GetHeap();
-    auto ans = heap->Make<Lambda>();
-    ans->arguments = arguments;
+    auto ans = heap->Make<Lambda>(code_, my_scope_);
     ans->name = name;
-    ans->SetScope(my_scope_);
-    ans->SetCall(call_->Copy());
     return ans;
 }
 std::string Lambda::ToString() const {
     std::string ans = "<lambda '" + name + "' with args:";
-    for (size_t i = 0; i < arguments.size(); ++i) {
-        ans += " '" + arguments[i] + "'";
+    for (auto& argument : code_->arguments) {
+        ans += " '" + GetSymbolName(argument) + "'";
     }
     ans += ">";
     return ans;
 }
+LambdaNode* Lambda::GetCode() const {
+    return code_;
+}
 Scope* Lambda::GetScope() const {
     return my_scope_;
 }
-Object* Lambda::GetCall() const {
-    return call_;
+
+Vector::Vector(std::vector<Object*> elements)
+    : Object(ObjectType::Vector), elements_(std::move(elements)) {
+}
+Object* Vector::Copy() const {
+    static auto heap = GetHeap();
+    return heap->Make<Vector>(elements_);
+}
+std::string Vector::ToString() const {
+    std::string answer = "#(";
+    for (size_t i = 0; i < elements_.size(); ++i) {
+        if (i > 0) {
+            answer += " ";
+        }
+        answer += elements_[i] == nullptr ? "()" : ObjectToString(elements_[i]);
+    }
+    answer += ")";
+    return answer;
 }
-void Lambda::SetScope(Scope* scope) {
-    RemoveDependency(my_scope_);
-    AddDependency(scope);
-    my_scope_ = scope;
+void Vector::Trace(std::vector<Object*>* edges) const {
+    edges->insert(edges->end(), elements_.begin(), elements_.end());
 }
-void Lambda::SetCall(Object* call) {
-    RemoveDependency(call);
-    AddDependency(call);
-    call_ = call;
+const std::vector<Object*>& Vector::GetElements() const {
+    return elements_;
+}
+void Vector::Fill(Object* value) {
+    std::fill(elements_.begin(), elements_.end(), value);
+}
+
+// Concatenations up to this size are copied, a rope would save little.
+static constexpr size_t kFlatConcatSize = 64;
+
+String::String(std::string_view value)
+    : Object(ObjectType::String), size_(value.size()), is_rope_(false) {
+    auto characters = storage_.characters;
+    if (size_ > kInlineSize) {
+        characters = storage_.buffer = new char[size_];
+    }
+    std::copy(value.begin(), value.end(), characters);
+}
+String::String(String* left, String* right)
+    : Object(ObjectType::String), size_(left->size_ + right->size_), is_rope_(true) {
+    storage_.rope = {left, right};
+}
+String::~String() {
+    if (!is_rope_ && size_ > kInlineSize) {
+        delete[] storage_.buffer;
+    }
+}
+Object* String::Copy() const {
+    return MakeString(GetView());
+}
+std::string String::ToString() const {
+    std::string answer = "\"";
+    for (auto character : GetView()) {
+        if (character == '"' || character == '\\') {
+            answer += '\\';
+        } else if (character == '\n') {
+            answer += "\\n";
+            continue;
+        }
+        answer += character;
+    }
+    answer += '"';
+    return answer;
+}
+void String::Trace(std::vector<Object*>* edges) const {
+    if (is_rope_) {
+        edges->push_back(storage_.rope.left);
+        edges->push_back(storage_.rope.right);
+    }
+}
+std::string_view String::GetView() const {
+    if (is_rope_) {
+        Flatten();
+    }
+    if (size_ <= kInlineSize) {
+        return {storage_.characters, size_};
+    }
+    return {storage_.buffer, size_};
+}
+// Ropes built by appending in a loop are deep, so the parts are walked with a stack.
+void String::Flatten() const {
+    auto buffer = new char[size_];
+    size_t size = 0;
+    std::vector<const String*> pending{storage_.rope.right, storage_.rope.left};
+    while (!pending.empty()) {
+        auto part = pending.back();
+        pending.pop_back();
+        if (part->is_rope_) {
+            pending.push_back(part->storage_.rope.right);
+            pending.push_back(part->storage_.rope.left);
+            continue;
+        }
+        auto view = part->GetView();
+        std::copy(view.begin(), view.end(), buffer + size);
+        size += view.size();
+    }
+    storage_.buffer = buffer;
+    is_rope_ = false;
+}
+
+String* MakeString(std::string_view value) {
+    static auto heap = GetHeap();
+    return heap->Make<String>(value);
+}
+
+String* ConcatStrings(String* left, String* right) {
+    static auto heap = GetHeap();
+    if (left->GetSize() == 0) {
+        return right;
+    }
+    if (right->GetSize() == 0) {
+        return left;
+    }
+    if (left->GetSize() + right->GetSize() <= kFlatConcatSize) {
+        std::string value(left->GetView());
+        value += right->GetView();
+        return MakeString(value);
+    }
+    return heap->Make<String>(left, right);
+}
+
+Object* Unbound() {
+    static Object* unbound = [] {
+        auto heap = GetHeap();
+        auto object = heap->Make<Empty>();
+        heap->AddRootDependency(object);
+        return object;
+    }();
+    return unbound;
+}
+
+Object* Boolean(bool value) {
+    static Object* const booleans[] = {MakeSymbol(Intern("#f")), MakeSymbol(Intern("#t"))};
+    return booleans[value];
+}
+
+Object* Unspecified() {
+    static Object* unspecified = [] {
+        auto heap = GetHeap();
+        auto object = heap->Make<Empty>();
+        heap->AddRootDependency(object);
+        return object;
+    }();
+    return unspecified;
 }
@@ -1,21 +1,46 @@
 #pragma once
 
-#include <set>
+#include <cstdint>
+#include <span>
 #include <stdexcept>
 #include <string>
-#include <typeinfo>
-#include <map>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include "bignum.h"
 #include "int_type.h"
+#include "symbols.h"
 
 class Heap;
 
+// Tag of the most derived type of an object, Is and As compare it instead of casting.
+// The tags of the subtypes of a type are next to each other, so the type covers their range.
+enum class ObjectType : uint8_t {
+    Empty,
+    Number,
+    Symbol,
+    Scope,
+    Lambda,
+    Node,
+    Prototype,
+    Box,
+    Closure,
+    Vector,
+    String,
+    // builtins, the ones checked by Is are tagged separately
+    Function,
+    IsMonotonic,
+    IntOperations,
+    Memoized,
+};
+
 class Object {
     friend class Heap;
 
 protected:
-    Object();
+    explicit Object(ObjectType type);
 
 public:
     Object& operator=(const Object& other) = delete;
@@ -23,73 +48,137 @@ public:
     virtual std::string ToString() const = 0;
     virtual ~Object() = default;
 
-protected:
-    void AddDependency(Object* other);
-    void RemoveDependency(Object* other);
+    ObjectType GetType() const {
+        return type_;
+    }
+
+    // Appends the objects referenced by the fields, the collector marks them as reachable.
+    // Pairs, fixnums and nullptr may be appended as well.
+    virtual void Trace(std::vector<Object*>* edges) const;
 
 private:
-    std::multiset<Object*> dependency_;
+    const ObjectType type_;
     bool mark_bit_;
 };
 
+// Tags of T and its subtypes, defined for the types Is and As accept.
+template <class T>
+struct TypeRange;
+
+template <ObjectType first, ObjectType last = first>
+struct TypeRangeOf {
+    static constexpr ObjectType kFirst = first;
+    static constexpr ObjectType kLast = last;
+};
+
+template <>
+struct TypeRange<Object> : TypeRangeOf<ObjectType::Empty, ObjectType::Memoized> {};
+
 class Empty : public Object {
     friend class Heap;
 
 private:
-    Empty() = default;
+    Empty();
 
 public:
     Object* Copy() const override;
     std::string ToString() const override;
 };
 
+// Integers, that fit into 63 bits, are not allocated: such a fixnum is stored in place of
+// the pointer, the value shifted left with the lowest bit set. Heap objects are aligned,
+// so their lowest bit is clear. Number objects hold the remaining integers of any size,
+// so a value has exactly one representation.
+constexpr Int kFixnumMin = kIntMin / 2;
+constexpr Int kFixnumMax = kIntMax / 2;
+
+inline bool IsFixnum(const Object* object) {
+    return (reinterpret_cast<uintptr_t>(object) & 1) != 0;
+}
+
 class Number : public Object {
     friend class Heap;
 
 private:
-    Number(Int value);
+    Number(BigInt value);
 
 public:
-    Int GetValue() const;
+    const BigInt& GetValue() const;
 
     Object* Copy() const override;
     std::string ToString() const override;
 
 private:
-    Int value_;
+    BigInt value_;
 };
 
+template <>
+struct TypeRange<Number> : TypeRangeOf<ObjectType::Number> {};
+
+// A fixnum, or a Number if the value does not fit.
+Object* MakeNumber(Int value);
+Object* MakeNumber(const BigInt& value);
+
+inline Int GetFixnumValue(Object* fixnum) {
+    return static_cast<Int>(reinterpret_cast<intptr_t>(fixnum) >> 1);
+}
+
+// Value of a number, that fits into Int. Throws RuntimeError for larger ones.
+Int GetNumberValue(Object* number);
+BigInt GetBigValue(Object* number);
+
+// Virtual methods can't be called on a fixnum or a pair, these check for them first.
+std::string ObjectToString(Object* object);
+
+// There is one symbol for each name, see MakeSymbol, so symbols are equal if they are the same.
 class Symbol : public Object {
     friend class Heap;
 
 private:
-    Symbol(const std::string& symbol);
+    explicit Symbol(SymbolId id);
 
 public:
+    SymbolId GetId() const;
     const std::string& GetName() const;
 
     Object* Copy() const override;
     std::string ToString() const override;
 
 private:
-    std::string symbol_;
+    SymbolId id_;
 };
 
-class Cell : public Object {
+template <>
+struct TypeRange<Symbol> : TypeRangeOf<ObjectType::Symbol> {};
+
+// The symbol of the name, allocated on first use and never freed.
+Symbol* MakeSymbol(SymbolId id);
+
+// A pair is just its two fields, allocated by Heap::MakeCell in the cons space. It has no header:
+// its mark bit is kept aside, and the collector reads the fields to find what it references.
+// An Object* of a pair is the address of the cell with kConsTag set, Is and As convert it.
+class Cell {
     friend class Heap;
 
 private:
-    Cell(Object* first, Object* second);
+    Cell() = default;
 
 public:
-    Object* GetFirst() const;
-    Object* GetSecond() const;
+    Object* GetFirst() const {
+        return first_;
+    }
+    Object* GetSecond() const {
+        return second_;
+    }
 
-    void SetFirst(Object*);
-    void SetSecond(Object*);
+    void SetFirst(Object* first) {
+        first_ = first;
+    }
+    void SetSecond(Object* second) {
+        second_ = second;
+    }
 
-    Object* Copy() const override;
-    std::string ToString() const override;
+    std::string ToString() const;
 
 private:
     std::string ToString(bool in_list) const;
@@ -98,21 +187,55 @@ private:
     Object* second_;
 };
 
+static_assert(sizeof(Cell) == 2 * sizeof(Object*));
+
+constexpr uintptr_t kConsTag = 2;
+
+inline bool IsCons(const Object* object) {
+    return (reinterpret_cast<uintptr_t>(object) & 3) == kConsTag;
+}
+
+inline Object* ConsToObject(Cell* cell) {
+    return reinterpret_cast<Object*>(reinterpret_cast<uintptr_t>(cell) | kConsTag);
+}
+
+inline Cell* ObjectToCons(Object* object) {
+    return reinterpret_cast<Cell*>(reinterpret_cast<uintptr_t>(object) - kConsTag);
+}
+
+// Fixnums and pairs are not Objects, so an Object* points to one only if this is true.
+inline bool IsHeapObject(const Object* object) {
+    return object != nullptr && (reinterpret_cast<uintptr_t>(object) & 3) == 0;
+}
+
 class Interpreter;
 
+// Arguments of a call, a view of the values on the stack of the evaluator.
+using ArgsType = std::span<Object* const>;
+
 struct BasicFunction : Object {
     friend class Heap;
 
 protected:
-    BasicFunction() = default;
+    explicit BasicFunction(ObjectType type);
 
 public:
-    virtual Object* Call(Interpreter* interpreter, Object* argument) = 0;
+    virtual Object* Call(Interpreter* interpreter, const ArgsType& arguments) = 0;
     virtual ~BasicFunction() = default;
 
     Object* Copy() const override;
 };
 
+// Variable cell. Its address is stable, so code can keep a pointer to it.
+// A binding may exist before its name is defined, its value is Unbound() until then.
+struct Binding {
+    SymbolId name;
+    Object* value;
+    // for global bindings: the name is also bound in some lambda scope,
+    // so reading it has to walk the scope chain
+    bool shadowed = false;
+};
+
 struct Scope : Object {
     friend class Heap;
 
@@ -121,68 +244,183 @@ private:
     Scope(Scope* previos);
 
 public:
-    inline static size_t free_index;
-
     Object* Copy() const override;
     std::string ToString() const override;
+    void Trace(std::vector<Object*>* edges) const override;
 
-    void AddScope(const std::string& name, Scope* scope);
-    void AddValue(const std::string& name, Object* value);
+    void AddValue(SymbolId name, Object* value);
 
-    void RemoveScope(const std::string& name);
+    Binding* GetBinding(SymbolId name);
+    // nullptr if the name is not bound
+    Binding* FindBinding(SymbolId name);
+    void SetValue(Binding* binding, Object* value);
 
-    const std::map<std::string, Scope*>& GetScopes() const;
-    const std::map<std::string, Object*>& GetValues() const;
     Scope* GetPrevios() const;
+    // Unbinds every name and links the scope to another one, so it could be used again.
+    void Reset(Scope* previos);
+
+    // scope of a call, that is reused once the call is over
+    bool reusable = false;
 
 private:
     Scope* previos_;
-    std::map<std::string, Scope*> scopes_;
-    std::map<std::string, Object*> values_;
+    std::unordered_map<SymbolId, Binding> bindings_;
 };
 
+struct LambdaNode;
+
 struct Lambda : Object {
     friend class Heap;
 
 private:
-    Lambda() = default;
+    Lambda(LambdaNode* code, Scope* scope);
 
 public:
-    std::vector<std::string> arguments;
+    // lambdas of both evaluators are named by it
+    inline static size_t free_index;
+
     std::string name;
 
     Object* Copy() const override;
     std::string ToString() const override;
+    void Trace(std::vector<Object*>* edges) const override;
 
+    LambdaNode* GetCode() const;
     Scope* GetScope() const;
-    Object* GetCall() const;
-    void SetScope(Scope* scope);
-    void SetCall(Object* call);
 
 private:
+    LambdaNode* code_;
     Scope* my_scope_;
-    Object* call_;
 };
 
+// Elements are stored contiguously, so they are read and written by index in constant time.
+class Vector : public Object {
+    friend class Heap;
+
+private:
+    explicit Vector(std::vector<Object*> elements);
+
+public:
+    Object* Copy() const override;
+    std::string ToString() const override;
+    void Trace(std::vector<Object*>* edges) const override;
+
+    size_t GetSize() const {
+        return elements_.size();
+    }
+    Object* Get(size_t index) const {
+        return elements_[index];
+    }
+    void Set(size_t index, Object* value) {
+        elements_[index] = value;
+    }
+    const std::vector<Object*>& GetElements() const;
+    void Fill(Object* value);
+
+private:
+    std::vector<Object*> elements_;
+};
+
+template <>
+struct TypeRange<Vector> : TypeRangeOf<ObjectType::Vector> {};
+// Immutable. Strings of up to kInlineSize characters are stored in the object itself, longer ones
+// in a buffer of their own. A long concatenation is a rope: it references both parts and copies
+// their characters only when they are read, so appending pieces one by one is not quadratic.
+class String : public Object {
+    friend class Heap;
+
+private:
+    explicit String(std::string_view value);
+    String(String* left, String* right);
+
+public:
+    static constexpr size_t kInlineSize = 2 * sizeof(String*);
+
+    ~String() override;
+
+    Object* Copy() const override;
+    // quoted, with the escapes the tokenizer reads
+    std::string ToString() const override;
+    void Trace(std::vector<Object*>* edges) const override;
+
+    size_t GetSize() const {
+        return size_;
+    }
+    // Flattens a rope on the first call.
+    std::string_view GetView() const;
+
+private:
+    void Flatten() const;
+
+    union Storage {
+        char characters[kInlineSize];
+        char* buffer;
+        // parts of a rope, dropped once it is flattened
+        struct {
+            String* left;
+            String* right;
+        } rope;
+    };
+
+    size_t size_;
+    mutable bool is_rope_;
+    mutable Storage storage_;
+};
+
+template <>
+struct TypeRange<String> : TypeRangeOf<ObjectType::String> {};
+
+String* MakeString(std::string_view value);
+// Short results are copied right away, longer ones are ropes.
+String* ConcatStrings(String* left, String* right);
+
+template <>
+struct TypeRange<BasicFunction> : TypeRangeOf<ObjectType::Function, ObjectType::Memoized> {};
+template <>
+struct TypeRange<Lambda> : TypeRangeOf<ObjectType::Lambda> {};
+
+// Marker for variables that have a slot but no value yet.
+Object* Unbound();
+// #t or #f. Both are symbols allocated once, so no other object is a boolean.
+Object* Boolean(bool value);
+// Value of define, set! and other forms evaluated for their effect.
+Object* Unspecified();
+
 ///////////////////////////////////////////////////////////////////////////////
 
 // Runtime type checking and convertion.
-// This can be helpful: https://en.cppreference.com/w/cpp/memory/shared_ptr/pointer_cast
 
 template <class T>
-T* As(Object* obj) {
-    auto ans = dynamic_cast<T*>(obj);
-    if (ans == nullptr) {
-        throw std::runtime_error("using As<T> while type is incorrect");
+bool Is(Object* obj) {
+    if (IsFixnum(obj)) {
+        return std::is_same_v<T, Number> || std::is_same_v<T, Object>;
+    }
+    if (IsCons(obj)) {
+        return std::is_same_v<T, Cell> || std::is_same_v<T, Object>;
+    }
+    if constexpr (std::is_same_v<T, Cell>) {
+        return false;
+    } else {
+        if (obj == nullptr) {
+            return false;
+        }
+        auto type = obj->GetType();
+        return type >= TypeRange<T>::kFirst && type <= TypeRange<T>::kLast;
     }
-    return ans;
 }
 
+// A fixnum is a Number, but it can't be viewed as one: read it with GetNumberValue.
+// The type is checked only in debug builds, callers check it with Is first.
 template <class T>
-bool Is(Object* obj) {
-    auto ans = dynamic_cast<T*>(obj);
-    if (ans == nullptr) {
-        return false;
+T* As(Object* obj) {
+#ifndef NDEBUG
+    if (IsFixnum(obj) || !Is<T>(obj)) {
+        throw std::runtime_error("using As<T> while type is incorrect");
+    }
+#endif
+    if constexpr (std::is_same_v<T, Cell>) {
+        return ObjectToCons(obj);
+    } else {
+        return static_cast<T*>(obj);
     }
-    return true;
 }
@@ -30,31 +30,40 @@ static Object* ReadList(Tokenizer* tokenizer) {
         if (BracketToken* current = std::get_if<BracketToken>(&current_token)) {
             if (*current == BracketToken::CLOSE) {
                 tokenizer->Next();
-                return heap->Make<Cell>(first, second);
+                return heap->MakeCell(first, second);
             }
         }
         throw SyntaxError("List haven't ended with close bracket");
     }
     auto second = ReadList(tokenizer);
-    return heap->Make<Cell>(first, second);
+    return heap->MakeCell(first, second);
 }
 Object* Read(Tokenizer* tokenizer) {
     static auto heap = GetHeap();
     auto current_token = SafeGet(tokenizer);
     if (ConstantToken* current = std::get_if<ConstantToken>(&current_token)) {
         tokenizer->Next();
-        return heap->Make<Number>(current->value);
+        return MakeNumber(current->value);
+    }
+    if (BigConstantToken* current = std::get_if<BigConstantToken>(&current_token)) {
+        tokenizer->Next();
+        return MakeNumber(current->value);
+    }
+    if (StringToken* current = std::get_if<StringToken>(&current_token)) {
+        tokenizer->Next();
+        return MakeString(current->value);
     }
     if (SymbolToken* current = std::get_if<SymbolToken>(&current_token)) {
         tokenizer->Next();
-        return heap->Make<Symbol>(current->name);
+        return MakeSymbol(current->id);
     }
     if ([[maybe_unused]] QuoteToken* current = std::get_if<QuoteToken>(&current_token)) {
         tokenizer->Next();
-        auto first = heap->Make<Symbol>("quote");
+        static const auto quote = Intern("quote");
+        auto first = MakeSymbol(quote);
         auto arg = Read(tokenizer);
-        auto second = heap->Make<Cell>(arg, nullptr);
-        return heap->Make<Cell>(first, second);
+        auto second = heap->MakeCell(arg, nullptr);
+        return heap->MakeCell(first, second);
     }
     if ([[maybe_unused]] DotToken* current = std::get_if<DotToken>(&current_token)) {
         throw SyntaxError("Unexpected dot token");
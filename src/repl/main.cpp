@@ -1,13 +1,30 @@
 #include <cstdio>
 #include <iostream>
 #include <memory>
+#include <string>
 
 #include "error.h"
 #include "heap.h"
 #include "scheme.h"
 
-int main() {
-    std::unique_ptr<Interpreter> inter = std::make_unique<Interpreter>();
+int main(int argc, char** argv) {
+    auto evaluator = EvaluatorType::Bytecode;
+    bool jit = true;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--tree-walking") {
+            evaluator = EvaluatorType::TreeWalking;
+        } else if (option == "--bytecode") {
+            evaluator = EvaluatorType::Bytecode;
+        } else if (option == "--no-jit") {
+            jit = false;
+        } else {
+            std::cerr << "unknown option '" << option << "'\n";
+            return 1;
+        }
+    }
+    std::unique_ptr<Interpreter> inter = std::make_unique<Interpreter>(evaluator);
+    inter->SetJitEnabled(jit);
     while (true) {
         if (std::cin.eof()) {
             break;
@@ -1,51 +1,52 @@
 #include "scheme.h"
 #include <cassert>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
+#include "compiler.h"
+#include "constant_folder.h"
 #include "error.h"
 #include "functions.h"
 #include "heap.h"
 #include "object.h"
 #include "tokenizer.h"
+#include "vm.h"
 
-static Object* ReadSymbol(const std::string& name, Scope* current_scope) {
+Object* ReadSymbol(SymbolId name, Scope* current_scope) {
     if (current_scope == nullptr) {
-        throw NameError("Unknow symbol '" + name + "'");
+        throw NameError("Unknow symbol '" + GetSymbolName(name) + "'");
     }
-    const auto& values = current_scope->GetValues();
-    if (auto it = values.find(name); it != values.end()) {
-        return it->second;
+    if (auto binding = current_scope->FindBinding(name)) {
+        return binding->value;
     }
     return ReadSymbol(name, current_scope->GetPrevios());
 }
-static Scope* FindScope(const std::string& name, Scope* current_scope) {
+Scope* FindScope(SymbolId name, Scope* current_scope) {
     if (current_scope == nullptr) {
-        throw NameError("Unknow symbol '" + name + "'");
+        throw NameError("Unknow symbol '" + GetSymbolName(name) + "'");
     }
-    const auto& values = current_scope->GetValues();
-    if (auto it = values.find(name); it != values.end()) {
+    if (current_scope->FindBinding(name)) {
         return current_scope;
     }
     return FindScope(name, current_scope->GetPrevios());
 }
 
-Interpreter::Interpreter() {
+Interpreter::Interpreter(EvaluatorType evaluator)
+    : evaluator_(evaluator), vm_(std::make_unique<VirtualMachine>(this)) {
     static auto heap = GetHeap();
+    heap->AddRootProvider(this);
     default_scope_ = heap->Make<Scope>();
     current_scope_ = default_scope_;
     heap->AddRootDependency(default_scope_);
 
-    Scope::free_index = 0;
-    LambdaFunction::free_index = 0;
+    Lambda::free_index = 0;
 
     // true/false symbols
-    DefineValue("#t", heap->Make<Symbol>("#t"));
-    DefineValue("#f", heap->Make<Symbol>("#f"));
-
-    InitFunction(heap->Make<Quote>());
+    DefineValue(Intern("#t"), Boolean(true));
+    DefineValue(Intern("#f"), Boolean(false));
 
     // Integer funtions:
     InitFunction(heap->Make<IsNumber>());
@@ -56,30 +57,50 @@ Interpreter::Interpreter() {
     InitFunction(heap->Make<IsMonotonic>([](Int a, Int b) { return a <= b; }, "<="));
     InitFunction(heap->Make<IsMonotonic>([](Int a, Int b) { return a >= b; }, ">="));
 
-    InitFunction(heap->Make<IntOperations>([](Int a, Int b) { return a + b; }, 0, 0, -1, "+"));
-    InitFunction(heap->Make<IntOperations>([](Int a, Int b) { return a - b; }, 0, 1, -1, "-"));
-    InitFunction(heap->Make<IntOperations>([](Int a, Int b) { return a * b; }, 1, 0, -1, "*"));
+    // Fixnums take 63 bits, so only their products could overflow Int.
+    InitFunction(heap->Make<IntOperations>(
+        [](Int a, Int b) -> std::optional<Int> { return a + b; },
+        [](const BigInt& a, const BigInt& b) { return a + b; }, 0, 0, -1, "+"));
+    InitFunction(heap->Make<IntOperations>(
+        [](Int a, Int b) -> std::optional<Int> { return a - b; },
+        [](const BigInt& a, const BigInt& b) { return a - b; }, 0, 1, -1, "-"));
+    InitFunction(heap->Make<IntOperations>(
+        [](Int a, Int b) -> std::optional<Int> {
+            Int result;
+            if (__builtin_mul_overflow(a, b, &result)) {
+                return std::nullopt;
+            }
+            return result;
+        },
+        [](const BigInt& a, const BigInt& b) { return a * b; }, 1, 0, -1, "*"));
     InitFunction(heap->Make<IntOperations>(
-        [](Int a, Int b) {
+        [](Int a, Int b) -> std::optional<Int> {
             if (b == 0) {
                 throw RuntimeError("division by zero");
             }
             return a / b;
         },
+        [](const BigInt& a, const BigInt& b) {
+            if (b.IsZero()) {
+                throw RuntimeError("division by zero");
+            }
+            return a / b;
+        },
         1, 1, -1, "/"));
 
-    InitFunction(
-        heap->Make<IntOperations>([](Int a, Int b) { return std::max(a, b); }, 0, 1, -1, "max"));
-    InitFunction(
-        heap->Make<IntOperations>([](Int a, Int b) { return std::min(a, b); }, 0, 1, -1, "min"));
+    InitFunction(heap->Make<IntOperations>(
+        [](Int a, Int b) -> std::optional<Int> { return std::max(a, b); },
+        [](const BigInt& a, const BigInt& b) { return std::max(a, b); }, 0, 1, -1, "max"));
+    InitFunction(heap->Make<IntOperations>(
+        [](Int a, Int b) -> std::optional<Int> { return std::min(a, b); },
+        [](const BigInt& a, const BigInt& b) { return std::min(a, b); }, 0, 1, -1, "min"));
 
-    InitFunction(heap->Make<IntSoloArgumentOperation>([](Int a) { return std::abs(a); }, "abs"));
+    InitFunction(heap->Make<IntSoloArgumentOperation>(
+        [](Int a) { return std::abs(a); }, [](const BigInt& a) { return a.Abs(); }, "abs"));
 
     // boolean functions:
     InitFunction(heap->Make<IsBoolean>());
     InitFunction(heap->Make<Not>());
-    InitFunction(heap->Make<And>());
-    InitFunction(heap->Make<Or>());
 
     // list functions:
     InitFunction(heap->Make<IsPair>());
@@ -94,18 +115,39 @@ Interpreter::Interpreter() {
     InitFunction(heap->Make<ListRef>());
     InitFunction(heap->Make<ListTail>());
 
+    // vector functions:
+    InitFunction(heap->Make<MakeVector>());
+    InitFunction(heap->Make<VectorOf>());
+    InitFunction(heap->Make<VectorRef>());
+    InitFunction(heap->Make<VectorSet>());
+    InitFunction(heap->Make<VectorLength>());
+    InitFunction(heap->Make<VectorFill>());
+    InitFunction(heap->Make<ListToVector>());
+    InitFunction(heap->Make<VectorToList>());
+
+    // string functions:
+    InitFunction(heap->Make<IsString>());
+    InitFunction(heap->Make<StringAppend>());
+    InitFunction(heap->Make<Substring>());
+    InitFunction(heap->Make<StringLength>());
+    InitFunction(heap->Make<StringEquals>());
+    InitFunction(heap->Make<StringToSymbol>());
+    InitFunction(heap->Make<SymbolToString>());
+
     // advanced:
     InitFunction(heap->Make<IsSymbol>());
-    InitFunction(heap->Make<If>());
-    InitFunction(heap->Make<Define>());
-    InitFunction(heap->Make<Set>());
     InitFunction(heap->Make<SetCar>());
     InitFunction(heap->Make<SetCdr>());
-    InitFunction(heap->Make<LambdaFunction>());
+    InitFunction(heap->Make<Memoize>());
 
     heap->DeleteUnuse();
 }
 
+Interpreter::~Interpreter() {
+    GetHeap()->RemoveRootProvider(this);
+    GetHeap()->RemoveRootDependencty(default_scope_);
+}
+
 std::string Interpreter::Run(const std::string& s) {
     static auto heap = GetHeap();
     heap->DeleteUnuse();
@@ -116,9 +158,19 @@ std::string Interpreter::Run(const std::string& s) {
     if (!tokenizer.IsEnd()) {
         throw SyntaxError("expected end of line");
     }
+    auto node = ConstantFolder(default_scope_).Fold(AstBuilder().Build(compiled));
     current_scope_ = default_scope_;
-    auto executed = Execute(compiled);
+    roots_.clear();
+    Object* executed = nullptr;
+    if (evaluator_ == EvaluatorType::Bytecode) {
+        auto prototype = BytecodeCompiler(default_scope_).CompileTopLevel(node);
+        executed = vm_->Run(prototype, default_scope_);
+    } else {
+        PushRoot(node);
+        executed = Execute(node);
+    }
     answer += Convert(executed);
+    roots_.clear();
 
     heap->DeleteUnuse();
     return answer;
@@ -129,120 +181,418 @@ Object* Interpreter::Compile(Tokenizer* tokenizer) {
     return ans;
 }
 
-Object* Interpreter::Execute(Object* to_execute) {
-    if (to_execute == nullptr) {
-        throw RuntimeError("can't execute nullptr");
-    }
-    if (Is<Number>(to_execute)) {
-        return to_execute;
-    }
-    if (Is<Symbol>(to_execute)) {
-        return CallSymbol(As<Symbol>(to_execute));
+[[noreturn]] static void ThrowNotCallable(Object* callee) {
+    std::string trying_to_call = Interpreter::Convert(callee);
+    throw RuntimeError("can't call non function / lambda object '" + trying_to_call + "'");
+}
+
+// Every activation roots the scope to return to, the node it evaluates and its callee.
+Object* Interpreter::Execute(Node* node) {
+    auto caller_scope = current_scope_;
+    auto roots_base = roots_.size();
+    roots_.insert(roots_.end(), {caller_scope, node, nullptr});
+    try {
+        auto result = ExecuteInScope(node, roots_base);
+        LeaveScope(caller_scope);
+        PopRoots(roots_base);
+        return result;
+    } catch (...) {
+        LeaveScope(caller_scope);
+        PopRoots(roots_base);
+        throw;
     }
-    if (Is<BasicFunction>(to_execute)) {
-        return to_execute;
+}
+
+// Tail positions (bodies of lambdas, lets, if, and, or) are evaluated by the same loop,
+// so tail calls neither grow the native stack nor keep the caller's scope alive.
+Object* Interpreter::ExecuteInScope(Node* node, size_t roots_base) {
+    static auto heap = GetHeap();
+    // recur nodes are in the tail positions of the innermost loop, so it is entered here
+    LetNode* loop = nullptr;
+    Scope* loop_scope = nullptr;
+    while (true) {
+        roots_[roots_base + 1] = node;
+        // safe point: everything alive is rooted by this or an outer activation
+        if (heap->ShouldCollect()) {
+            heap->DeleteUnuse();
+        }
+        switch (node->kind) {
+            case NodeKind::Constant:
+                return static_cast<ConstantNode*>(node)->value;
+            case NodeKind::Variable:
+                return ReadVariable(static_cast<VariableNode*>(node));
+            case NodeKind::If: {
+                auto if_node = static_cast<IfNode*>(node);
+                if (IsTrue(Execute(if_node->condition))) {
+                    node = if_node->consequent;
+                } else if (if_node->alternative != nullptr) {
+                    node = if_node->alternative;
+                } else {
+                    return nullptr;
+                }
+                continue;
+            }
+            case NodeKind::Define: {
+                auto define = static_cast<AssignNode*>(node);
+                DefineValue(define->name, Execute(define->value));
+                return Unspecified();
+            }
+            case NodeKind::Set: {
+                auto set = static_cast<AssignNode*>(node);
+                SetValue(set->name, Execute(set->value));
+                return Unspecified();
+            }
+            case NodeKind::Lambda:
+                return MakeLambda(static_cast<LambdaNode*>(node));
+            case NodeKind::Folded: {
+                auto folded = static_cast<FoldedNode*>(node);
+                if (folded->Holds()) {
+                    return folded->value;
+                }
+                node = folded->original;
+                continue;
+            }
+            case NodeKind::Let:
+            case NodeKind::Letrec:
+                node = EnterLet(static_cast<LetNode*>(node));
+                continue;
+            case NodeKind::Loop:
+                loop = static_cast<LetNode*>(node);
+                node = EnterLet(loop);
+                loop_scope = current_scope_;
+                continue;
+            case NodeKind::Recur:
+                node = Recur(static_cast<RecurNode*>(node), loop, &loop_scope);
+                continue;
+            case NodeKind::And:
+            case NodeKind::Or: {
+                auto logical = static_cast<LogicalNode*>(node);
+                // and stops at the first false value, or at the first true one
+                bool stop_at = logical->kind == NodeKind::Or;
+                auto& operands = logical->operands;
+                for (size_t i = 0; i + 1 < operands.size(); ++i) {
+                    auto value = Execute(operands[i]);
+                    if (IsTrue(value) == stop_at) {
+                        return value;
+                    }
+                }
+                node = operands.back();
+                continue;
+            }
+            case NodeKind::Call: {
+                auto call = static_cast<CallNode*>(node);
+                auto callee = Execute(call->callee);
+                roots_[roots_base + 2] = callee;
+                if (call->improper) {
+                    if (Is<BasicFunction>(callee) || Is<Lambda>(callee)) {
+                        throw SyntaxError("improper list can't be interpreted as arguments.");
+                    }
+                    ThrowNotCallable(callee);
+                }
+                auto state = call->GetState();
+                if (state == CallState::Uninitialized) {
+                    Specialize(call, callee);
+                } else if (state != CallState::Generic && callee != call->GetCachedCallee()) {
+                    call->Deoptimize();
+                }
+                state = call->GetState();
+                if (state == CallState::FixnumOperation || state == CallState::FixnumComparison) {
+                    return CallFixnums(call, callee);
+                }
+
+                // the evaluated arguments are rooted, and the roots are passed as the arguments
+                auto roots_size = GetRootsSize();
+                for (auto argument : call->arguments) {
+                    PushRoot(Execute(argument));
+                }
+                ArgsType arguments(roots_.data() + roots_size, call->arguments.size());
+                if (state == CallState::Lambda ||
+                    (state == CallState::Generic && Is<Lambda>(callee))) {
+                    // a tail call ends the call this activation entered
+                    LeaveScope(static_cast<Scope*>(roots_[roots_base]));
+                    node = EnterLambda(static_cast<Lambda*>(callee), arguments);
+                    PopRoots(roots_size);
+                    continue;
+                }
+                if (state == CallState::Builtin ||
+                    (state == CallState::Generic && Is<BasicFunction>(callee))) {
+                    auto result = static_cast<BasicFunction*>(callee)->Call(this, arguments);
+                    PopRoots(roots_size);
+                    return result;
+                }
+                ThrowNotCallable(callee);
+            }
+        }
     }
-    if (Is<Lambda>(to_execute)) {
-        return to_execute;
+}
+
+Object* Interpreter::Apply(Object* callee, const ArgsType& arguments) {
+    if (evaluator_ == EvaluatorType::Bytecode) {
+        return vm_->Apply(callee, arguments);
     }
-    if (!Is<Cell>(to_execute)) {
-        throw RuntimeError("unexpected object passed to function Interpreter::Execute");
+    if (Is<BasicFunction>(callee)) {
+        return As<BasicFunction>(callee)->Call(this, arguments);
     }
-
-    auto call = As<Cell>(to_execute);
-    call->SetFirst(Execute(call->GetFirst()));
-    if (Is<BasicFunction>(call->GetFirst())) {
-        return CallFunction(As<BasicFunction>(call->GetFirst()), call->GetSecond());
+    if (!Is<Lambda>(callee)) {
+        ThrowNotCallable(callee);
     }
-    if (Is<Lambda>(call->GetFirst())) {
-        return CallLambda(As<Lambda>(call->GetFirst()), call->GetSecond());
+    auto caller_scope = current_scope_;
+    auto roots_base = GetRootsSize();
+    PushRoot(callee);
+    try {
+        auto result = Execute(EnterLambda(As<Lambda>(callee), arguments));
+        LeaveScope(caller_scope);
+        PopRoots(roots_base);
+        return result;
+    } catch (...) {
+        LeaveScope(caller_scope);
+        PopRoots(roots_base);
+        throw;
     }
-    std::string trying_to_call = Convert(call->GetFirst());
-    throw RuntimeError("can't call non function / lambda object '" + trying_to_call + "'");
 }
 
 std::string Interpreter::Convert(Object* to_convert) {
     if (to_convert == nullptr) {
         return "()";
     }
-    return to_convert->ToString();
+    return ObjectToString(to_convert);
 }
 
-void Interpreter::DefineValue(const std::string& name, Object* object) {
-    if (Is<BasicFunction>(object)) {
-        current_scope_->AddValue(name, object);
-    } else {
-        current_scope_->AddValue(name, object->Copy());
+void Interpreter::DefineValue(SymbolId name, Object* object) {
+    if (current_scope_ != default_scope_) {
+        DeclareLocal(name);
     }
+    current_scope_->AddValue(name, object);
+}
+
+void Interpreter::DeclareLocal(SymbolId name) {
+    default_scope_->GetBinding(name)->shadowed = true;
 }
 
-void Interpreter::SetValue(const std::string& name, Object* object) {
+void Interpreter::SetValue(SymbolId name, Object* object) {
     auto scope = FindScope(name, current_scope_);
-    if (Is<BasicFunction>(object)) {
-        scope->AddValue(name, object);
-    } else {
-        scope->AddValue(name, object->Copy());
-    }
+    scope->AddValue(name, object);
 }
 Scope* Interpreter::GetCurrentScope() const {
     return current_scope_;
 }
+Scope* Interpreter::GetGlobalScope() const {
+    return default_scope_;
+}
+EvaluatorType Interpreter::GetEvaluator() const {
+    return evaluator_;
+}
+
+void Interpreter::SetJitEnabled(bool enabled) {
+    vm_->SetJitEnabled(enabled);
+}
+
+std::vector<std::string> Interpreter::GetBacktrace() const {
+    return vm_->GetErrorBacktrace();
+}
+
+size_t Interpreter::GetRootsSize() const {
+    return roots_.size();
+}
+void Interpreter::PushRoot(Object* object) {
+    roots_.push_back(object);
+}
+void Interpreter::PopRoots(size_t size) {
+    roots_.resize(size);
+}
+void Interpreter::CollectRoots(std::vector<Object*>* roots) const {
+    roots->insert(roots->end(), roots_.begin(), roots_.end());
+    roots->insert(roots->end(), free_scopes_.begin(), free_scopes_.end());
+    roots->push_back(current_scope_);
+}
+
+void Interpreter::Specialize(CallNode* call, Object* callee) {
+    if (Is<Lambda>(callee)) {
+        call->Specialize(CallState::Lambda, callee);
+    } else if (call->arguments.size() == 2 && Is<IntOperations>(callee)) {
+        call->operation = As<IntOperations>(callee)->GetOperation();
+        call->Specialize(CallState::FixnumOperation, callee);
+    } else if (call->arguments.size() == 2 && Is<IsMonotonic>(callee)) {
+        call->comparison = As<IsMonotonic>(callee)->GetComparator();
+        call->Specialize(CallState::FixnumComparison, callee);
+    } else if (Is<BasicFunction>(callee)) {
+        call->Specialize(CallState::Builtin, callee);
+    } else {
+        call->Deoptimize();
+    }
+}
 
-Object* Interpreter::CallSymbol(Symbol* symbol) {
-    return ReadSymbol(symbol->GetName(), current_scope_);
+// Computes the builtin on fixnums without building the argument vector and checking arity.
+// Big numbers and overflows go through the builtin, arguments that are not numbers
+// deoptimize the call site.
+Object* Interpreter::CallFixnums(CallNode* call, Object* callee) {
+    auto roots_size = GetRootsSize();
+    auto left = Execute(call->arguments[0]);
+    PushRoot(left);
+    auto right = Execute(call->arguments[1]);
+    PopRoots(roots_size);
+    if (IsFixnum(left) && IsFixnum(right)) {
+        auto a = GetFixnumValue(left);
+        auto b = GetFixnumValue(right);
+        if (call->GetState() == CallState::FixnumComparison) {
+            return Boolean(call->comparison(a, b));
+        }
+        if (auto result = call->operation(a, b)) {
+            return MakeNumber(*result);
+        }
+    } else if (!Is<Number>(left) || !Is<Number>(right)) {
+        call->Deoptimize();
+    }
+    Object* arguments[] = {left, right};
+    return static_cast<BasicFunction*>(callee)->Call(this, arguments);
+}
+
+// Each variable node caches its global binding. Names never bound in lambda scopes
+// are read from it directly, redefinitions are seen since the binding is updated in place.
+Object* Interpreter::ReadVariable(VariableNode* node) {
+    auto binding = node->GetCachedBinding(default_scope_);
+    if (binding == nullptr) {
+        binding = default_scope_->GetBinding(node->name);
+        node->CacheBinding(default_scope_, binding);
+    }
+    if (binding->shadowed) {
+        return ReadSymbol(node->name, current_scope_);
+    }
+    if (binding->value == Unbound()) {
+        throw NameError("Unknow symbol '" + GetSymbolName(node->name) + "'");
+    }
+    return binding->value;
+}
+
+// Scopes of calls of lambdas and of lets, that create no lambdas, are referenced only while
+// they are current or enclose the current one, so they are kept for later calls instead of
+// being left to the collector.
+void Interpreter::LeaveScope(Scope* caller_scope) {
+    auto scope = current_scope_;
+    while (scope != caller_scope && scope->reusable) {
+        auto previos = scope->GetPrevios();
+        scope->Reset(nullptr);
+        free_scopes_.push_back(scope);
+        scope = previos;
+    }
+    current_scope_ = caller_scope;
 }
 
-Object* Interpreter::CallLambda(Lambda* lambda, Object* arguments) {
+Lambda* Interpreter::MakeLambda(LambdaNode* node) {
     static auto heap = GetHeap();
-    auto [status, v] = ToVector(arguments);
-    if (lambda->arguments.size() != v.size()) {
+    auto lambda = heap->Make<Lambda>(node, current_scope_);
+    lambda->name = "lambda_" + std::to_string(Lambda::free_index++);
+    for (auto& argument : node->arguments) {
+        DeclareLocal(argument);
+    }
+    return lambda;
+}
+
+// Binds arguments in a new scope, makes it current and enters the body.
+Node* Interpreter::EnterLambda(Lambda* lambda, const ArgsType& arguments) {
+    auto code = lambda->GetCode();
+    if (code->arguments.size() != arguments.size()) {
         std::string message =
             "invalid amount of arguments for lambda function '" + lambda->name + "'. ";
-        message += "Expected " + std::to_string(lambda->arguments.size()) + ", ";
-        message += "but got " + std::to_string(v.size());
+        message += "Expected " + std::to_string(code->arguments.size()) + ", ";
+        message += "but got " + std::to_string(arguments.size());
 
         message += "\nargs:";
-        for (size_t i = 0; i < v.size(); ++i) {
-            message += " " + Execute(v[i])->ToString();
+        for (auto argument : arguments) {
+            message += " " + Convert(argument);
         }
         throw RuntimeError(message);
     }
 
-    auto cs = current_scope_;
-    auto ns = lambda->GetScope();
-
-    std::string scope_name = "scope_" + std::to_string(Scope::free_index++);
-
-    ns->AddScope(scope_name, heap->Make<Scope>(ns));
-    ns = ns->GetScopes().at(scope_name);
+    auto scope = MakeScope(lambda->GetScope(), code->creates_lambdas);
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        scope->AddValue(code->arguments[i], arguments[i]);
+    }
+    current_scope_ = scope;
+    return EnterBody(code->body);
+}
 
-    for (size_t i = 0; i < v.size(); ++i) {
-        v[i] = Execute(v[i]);
+// Binds the names like a lambda call, but the scope is nested in the current one.
+// A let without names is just a sequence and needs no scope.
+Node* Interpreter::EnterLet(LetNode* let) {
+    if (let->kind == NodeKind::Let && let->scope_names.empty()) {
+        return EnterBody(let->body);
+    }
+    bool recursive = let->kind == NodeKind::Letrec;
+    auto roots_size = GetRootsSize();
+    if (!recursive) {
+        for (auto value : let->values) {
+            PushRoot(Execute(value));
+        }
+    }
+    auto scope = MakeScope(current_scope_, let->creates_lambdas);
+    current_scope_ = scope;
+    for (size_t i = 0; i < let->names.size(); ++i) {
+        DeclareLocal(let->names[i]);
+        if (!recursive) {
+            scope->AddValue(let->names[i], roots_[roots_size + i]);
+        }
     }
-    for (size_t i = 0; i < v.size(); ++i) {
-        ns->AddValue(lambda->arguments[i], v[i]);
+    PopRoots(roots_size);
+    if (recursive) {
+        for (size_t i = 0; i < let->names.size(); ++i) {
+            scope->AddValue(let->names[i], Execute(let->values[i]));
+        }
     }
+    return EnterBody(let->body);
+}
 
-    current_scope_ = ns;
+// Rebinds the names of the loop in its scope and starts the body again. Lambdas made by
+// the body could have captured the scope, then the next iteration gets a new one.
+Node* Interpreter::Recur(RecurNode* recur, LetNode* loop, Scope** loop_scope) {
+    auto roots_size = GetRootsSize();
+    for (auto argument : recur->arguments) {
+        PushRoot(Execute(argument));
+    }
+    LeaveScope(*loop_scope);
+    auto previos = (*loop_scope)->GetPrevios();
+    if (loop->creates_lambdas) {
+        *loop_scope = MakeScope(previos, true);
+    } else {
+        (*loop_scope)->Reset(previos);
+    }
+    current_scope_ = *loop_scope;
+    for (size_t i = 0; i < loop->names.size(); ++i) {
+        current_scope_->AddValue(loop->names[i], roots_[roots_size + i]);
+    }
+    PopRoots(roots_size);
+    return EnterBody(loop->body);
+}
 
-    auto [_, call_list] = ToVector(lambda->GetCall()->Copy());
-    Object* answer = nullptr;
-    for (auto& e : call_list) {
-        answer = Execute(e);
+// Evaluates the body except its last expression, which is returned to be evaluated
+// in the tail position.
+Node* Interpreter::EnterBody(const std::vector<Node*>& body) {
+    for (size_t i = 0; i + 1 < body.size(); ++i) {
+        Execute(body[i]);
     }
-    lambda->GetScope()->RemoveScope(scope_name);
-    current_scope_ = cs;
-    return answer;
+    return body.back();
 }
 
-Object* Interpreter::CallFunction(BasicFunction* function, Object* arguments) {
-    return function->Call(this, arguments);
+// Scopes that no lambda could capture are taken from the free ones.
+Scope* Interpreter::MakeScope(Scope* previos, bool captured) {
+    static auto heap = GetHeap();
+    if (captured) {
+        return heap->Make<Scope>(previos);
+    }
+    if (!free_scopes_.empty()) {
+        auto scope = free_scopes_.back();
+        free_scopes_.pop_back();
+        scope->Reset(previos);
+        return scope;
+    }
+    auto scope = heap->Make<Scope>(previos);
+    scope->reusable = true;
+    return scope;
 }
 
 void Interpreter::InitFunction(Object* function) {
     if (!Is<Function>(function)) {
         throw std::runtime_error("try to initializite function, that not derived from Function");
     }
-    auto name = As<Function>(function)->GetName();
-    default_scope_->AddValue(name, function);
+    default_scope_->AddValue(Intern(As<Function>(function)->GetName()), function);
 }
@@ -3,31 +3,78 @@
 #include <memory>
 #include <map>
 #include <string>
+#include <vector>
 
+#include "ast.h"
+#include "heap.h"
 #include "object.h"
 #include "parser.h"
+#include "symbols.h"
 #include "tokenizer.h"
 
-class Interpreter {
+class VirtualMachine;
+
+enum class EvaluatorType {
+    TreeWalking,
+    Bytecode,
+};
+
+Object* ReadSymbol(SymbolId name, Scope* current_scope);
+Scope* FindScope(SymbolId name, Scope* current_scope);
+
+class Interpreter : public RootProvider {
 public:
-    Interpreter();
+    explicit Interpreter(EvaluatorType evaluator = EvaluatorType::Bytecode);
+    ~Interpreter() override;
     std::string Run(const std::string&);
     Object* Compile(Tokenizer*);
-    Object* Execute(Object*);
+    Object* Execute(Node* node);
+    // Calls a lambda or a builtin on behalf of a builtin.
+    Object* Apply(Object* callee, const ArgsType& arguments);
     static std::string Convert(Object*);
 
-    void DefineValue(const std::string& name, Object* object);
-    void SetValue(const std::string& name, Object* object);
+    void DefineValue(SymbolId name, Object* object);
+    void SetValue(SymbolId name, Object* object);
+    // Every name bound outside of the global scope has to be declared,
+    // otherwise reads of it may skip the scope chain and see the global value.
+    void DeclareLocal(SymbolId name);
 
     Scope* GetCurrentScope() const;
+    Scope* GetGlobalScope() const;
+    EvaluatorType GetEvaluator() const;
+    // Native code for hot lambdas of the bytecode evaluator, enabled by default.
+    void SetJitEnabled(bool enabled);
+    // Lambdas that were active when the last Run failed, innermost first.
+    // Only the bytecode evaluator records them.
+    std::vector<std::string> GetBacktrace() const;
+
+    // Values that native code keeps across Execute calls have to be pushed here,
+    // otherwise the collector may free them at a safe point of a nested Execute.
+    size_t GetRootsSize() const;
+    void PushRoot(Object* object);
+    void PopRoots(size_t size);
+    void CollectRoots(std::vector<Object*>* roots) const override;
 
 private:
-    Object* CallSymbol(Symbol* symbol);
-    Object* CallLambda(Lambda* lambda, Object* arguments);
-    Object* CallFunction(BasicFunction* function, Object* arguments);
+    Object* ExecuteInScope(Node* node, size_t roots_base);
+    Object* ReadVariable(VariableNode* node);
+    void Specialize(CallNode* call, Object* callee);
+    Object* CallFixnums(CallNode* call, Object* callee);
+    Lambda* MakeLambda(LambdaNode* node);
+    Node* EnterLambda(Lambda* lambda, const ArgsType& arguments);
+    Node* EnterLet(LetNode* let);
+    Node* Recur(RecurNode* recur, LetNode* loop, Scope** loop_scope);
+    Node* EnterBody(const std::vector<Node*>& body);
+    Scope* MakeScope(Scope* previos, bool captured);
+    void LeaveScope(Scope* caller_scope);
 
     void InitFunction(Object* function);
 
+    EvaluatorType evaluator_;
+    std::unique_ptr<VirtualMachine> vm_;
+
     Scope* default_scope_;
     Scope* current_scope_;
+    std::vector<Object*> roots_;
+    std::vector<Scope*> free_scopes_;
 };
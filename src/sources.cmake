@@ -3,6 +3,14 @@ add_library(scheme
     parser.cpp
     scheme.cpp
     object.cpp
+    bignum.cpp
+    symbols.cpp
     functions.cpp
     heap.cpp
+    ast.cpp
+    bytecode.cpp
+    compiler.cpp
+    jit.cpp
+    constant_folder.cpp
+    vm.cpp
 )
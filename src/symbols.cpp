@@ -0,0 +1,35 @@
+#include "symbols.h"
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace {
+
+struct SymbolTable {
+    // a deque keeps the names in place, the index views them
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, SymbolId> ids;
+};
+
+SymbolTable& GetTable() {
+    static SymbolTable table;
+    return table;
+}
+
+}  // namespace
+
+SymbolId Intern(const std::string& name) {
+    auto& table = GetTable();
+    if (auto it = table.ids.find(name); it != table.ids.end()) {
+        return it->second;
+    }
+    auto id = static_cast<SymbolId>(table.names.size());
+    table.ids.emplace(table.names.emplace_back(name), id);
+    return id;
+}
+
+const std::string& GetSymbolName(SymbolId id) {
+    return GetTable().names[id];
+}
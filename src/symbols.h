@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Every name is interned once: equal names get the same id, so they are compared and looked up
+// by the id. Ids are small and stable for the whole run.
+using SymbolId = uint32_t;
+
+SymbolId Intern(const std::string& name);
+const std::string& GetSymbolName(SymbolId id);
@@ -4,13 +4,24 @@
 #include <variant>
 #include "error.h"
 #include "int_type.h"
+#include "symbols.h"
+
+SymbolToken::SymbolToken(SymbolId id) : id(id) {
+}
+
+SymbolToken::SymbolToken(const std::string& name) : id(Intern(name)) {
+}
+
+const std::string& SymbolToken::GetName() const {
+    return GetSymbolName(id);
+}
 
 bool SymbolToken::operator==(const SymbolToken& other) const {
-    return name == other.name;
+    return id == other.id;
 }
 
 std::ostream& operator<<(std::ostream& out, const SymbolToken& token) {
-    out << "[Symbol token {" << token.name << "}]";
+    out << "[Symbol token {" << token.GetName() << "}]";
     return out;
 }
 
@@ -41,6 +52,24 @@ std::ostream& operator<<(std::ostream& out, const ConstantToken& token) {
     return out;
 }
 
+bool BigConstantToken::operator==(const BigConstantToken& other) const {
+    return value == other.value;
+}
+
+std::ostream& operator<<(std::ostream& out, const BigConstantToken& token) {
+    out << "[Big constant token {" << token.value.ToString() << "}]";
+    return out;
+}
+
+bool StringToken::operator==(const StringToken& other) const {
+    return value == other.value;
+}
+
+std::ostream& operator<<(std::ostream& out, const StringToken& token) {
+    out << "[String token {" << token.value << "}]";
+    return out;
+}
+
 std::ostream& operator<<(std::ostream& out, const Token& token) {
     {
         auto* value = std::get_if<0>(&token);
@@ -72,6 +101,18 @@ std::ostream& operator<<(std::ostream& out, const Token& token) {
             out << *value;
         }
     }
+    {
+        auto* value = std::get_if<5>(&token);
+        if (value != nullptr) {
+            out << *value;
+        }
+    }
+    {
+        auto* value = std::get_if<6>(&token);
+        if (value != nullptr) {
+            out << *value;
+        }
+    }
     return out;
 }
 
@@ -107,6 +148,35 @@ static char Peek(std::istream* in) {
     return ch;
 }
 
+// Reads the rest of a string literal after its opening quote.
+static std::string ReadString(std::istream* in) {
+    std::string value;
+    while (true) {
+        if (in->peek() == std::istream::traits_type::eof()) {
+            throw SyntaxError("unterminated string");
+        }
+        char current = Get(in);
+        if (current == '"') {
+            return value;
+        }
+        if (current != '\\') {
+            value += current;
+            continue;
+        }
+        if (in->peek() == std::istream::traits_type::eof()) {
+            throw SyntaxError("unterminated string");
+        }
+        char escaped = Get(in);
+        if (escaped == 'n') {
+            value += '\n';
+        } else if (escaped == '"' || escaped == '\\') {
+            value += escaped;
+        } else {
+            throw SyntaxError(std::string("unknown escape sequence '\\") + escaped + "'");
+        }
+    }
+}
+
 static bool IsCorrectBeginSymbol(char ch) {
     if ('a' <= ch && ch <= 'z') {
         return true;
@@ -144,6 +214,8 @@ void Tokenizer::ReadToken() {
     bool digit_now = false;
     int digit_sign = 1;
     Int value = 0;
+    bool big = false;
+    std::string digits;
     bool symbol_now = false;
     std::string symbol;
     while (true) {
@@ -162,10 +234,14 @@ void Tokenizer::ReadToken() {
             } else if (current == '.') {
                 last_token_ = DotToken();
                 return;
+            } else if (current == '"') {
+                last_token_ = StringToken{ReadString(in_)};
+                return;
             } else if (isdigit(current)) {
                 digit_now = true;
                 digit_sign = 1;
                 value += current - '0';
+                digits += current;
                 continue;
             } else if (IsCorrectBeginSymbol(current)) {
                 symbol_now = true;
@@ -193,34 +269,30 @@ void Tokenizer::ReadToken() {
             continue;
         }
         if (digit_now) {
-            if (in_->eof()) {
-                last_token_ = ConstantToken{value};
+            if (in_->eof() || !isdigit(Peek(in_))) {
+                if (big) {
+                    last_token_ = BigConstantToken{BigInt::FromDecimal(digits, digit_sign == -1)};
+                } else {
+                    last_token_ = ConstantToken{value};
+                }
                 return;
             }
-            char will_next = Peek(in_);
-            if (isdigit(will_next)) {
-                Get(in_);
-                if (value > kIntMax / 10 || value < kIntMin / 10) {
-                    throw SyntaxError("number can't be presented as Int");
-                }
+            char will_next = Get(in_);
+            digits += will_next;
+            int to_add = will_next - '0';
+            // past the range of Int the literal is read from its digits at the end
+            if (big || value > kIntMax / 10 || value < kIntMin / 10) {
+                big = true;
+            } else if (digit_sign == 1) {
                 value *= 10;
-                if (digit_sign == 1) {
-                    int to_add = will_next - '0';
-                    if (value > kIntMax - to_add) {
-                        throw SyntaxError("number can't be presented as Int");
-                    }
-                    value += to_add;
-                } else {
-                    int to_add = will_next - '0';
-                    if (value < kIntMin + to_add) {
-                        throw SyntaxError("number can't be presented as Int");
-                    }
-                    value -= to_add;
-                }
-                continue;
+                big = value > kIntMax - to_add;
+                value += big ? 0 : to_add;
+            } else {
+                value *= 10;
+                big = value < kIntMin + to_add;
+                value -= big ? 0 : to_add;
             }
-            last_token_ = ConstantToken{value};
-            return;
+            continue;
         }
         if (symbol_now) {
             if (in_->eof()) {
@@ -4,11 +4,20 @@
 #include <optional>
 #include <istream>
 #include <ostream>
+#include <string>
 
+#include "bignum.h"
 #include "int_type.h"
+#include "symbols.h"
 
+// The name is interned by the tokenizer, the parser only looks up its symbol.
 struct SymbolToken {
-    std::string name;
+    explicit SymbolToken(SymbolId id);
+    explicit SymbolToken(const std::string& name);
+
+    SymbolId id;
+
+    const std::string& GetName() const;
 
     bool operator==(const SymbolToken& other) const;
 
@@ -37,7 +46,26 @@ struct ConstantToken {
     friend std::ostream& operator<<(std::ostream& out, const ConstantToken& token);
 };
 
-using Token = std::variant<ConstantToken, BracketToken, SymbolToken, QuoteToken, DotToken>;
+// A literal out of the range of Int.
+struct BigConstantToken {
+    BigInt value;
+
+    bool operator==(const BigConstantToken& other) const;
+
+    friend std::ostream& operator<<(std::ostream& out, const BigConstantToken& token);
+};
+
+// A string literal, with its escapes already replaced.
+struct StringToken {
+    std::string value;
+
+    bool operator==(const StringToken& other) const;
+
+    friend std::ostream& operator<<(std::ostream& out, const StringToken& token);
+};
+
+using Token = std::variant<ConstantToken, BracketToken, SymbolToken, QuoteToken, DotToken,
+                           BigConstantToken, StringToken>;
 
 std::ostream& operator<<(std::ostream& out, const Token& token);
 
@@ -0,0 +1,478 @@
+#include "vm.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "error.h"
+#include "functions.h"
+#include "heap.h"
+#include "jit.h"
+#include "scheme.h"
+
+static auto heap = GetHeap();
+
+// calls of a prototype before it is compiled to native code
+static constexpr size_t kJitThreshold = 1000;
+
+VirtualMachine::VirtualMachine(Interpreter* interpreter) : interpreter_(interpreter) {
+    heap->AddRootProvider(this);
+}
+
+VirtualMachine::~VirtualMachine() {
+    heap->RemoveRootProvider(this);
+}
+
+void VirtualMachine::CollectRoots(std::vector<Object*>* roots) const {
+    roots->insert(roots->end(), stack_.begin(), stack_.end());
+    for (auto& frame : frames_) {
+        roots->push_back(frame.prototype);
+        roots->push_back(frame.closure);
+    }
+}
+
+// The compiler emits boxed instructions only for slots holding boxes.
+static Box* AsBox(Object* object) {
+    return static_cast<Box*>(object);
+}
+
+static void ThrowUnbound(SymbolId name) {
+    throw NameError("Unknow symbol '" + GetSymbolName(name) + "'");
+}
+
+std::vector<std::string> VirtualMachine::Backtrace() const {
+    std::vector<std::string> backtrace;
+    backtrace.reserve(frames_.size());
+    for (auto it = frames_.rbegin(); it != frames_.rend(); ++it) {
+        backtrace.push_back(it->prototype->name);
+    }
+    return backtrace;
+}
+
+const std::vector<std::string>& VirtualMachine::GetErrorBacktrace() const {
+    return error_backtrace_;
+}
+
+void VirtualMachine::SetJitEnabled(bool enabled) {
+    jit_enabled_ = enabled;
+}
+
+// Scheme calls push onto frames_ instead of recursing in C++, so the recursion depth
+// is bounded by memory only.
+Object* VirtualMachine::Run(Prototype* prototype, Scope* globals) {
+    globals_ = globals;
+    error_backtrace_.clear();
+    auto entry_frames = frames_.size();
+    auto entry_stack = stack_.size();
+    // the top level has no callee
+    stack_.push_back(nullptr);
+    frames_.push_back({prototype, nullptr, 0, stack_.size()});
+    AllocateLocals();
+    return Execute(entry_frames, entry_stack);
+}
+
+Object* VirtualMachine::Apply(Object* callee, const ArgsType& arguments) {
+    if (Is<Function>(callee)) {
+        return As<Function>(callee)->Call(interpreter_, arguments);
+    }
+    if (!Is<Closure>(callee)) {
+        std::string trying_to_call = Interpreter::Convert(callee);
+        throw RuntimeError("can't call non function / lambda object '" + trying_to_call + "'");
+    }
+    auto entry_frames = frames_.size();
+    auto entry_stack = stack_.size();
+    stack_.push_back(callee);
+    stack_.insert(stack_.end(), arguments.begin(), arguments.end());
+    try {
+        CallClosure(As<Closure>(callee), arguments.size(), false);
+    } catch (...) {
+        stack_.resize(entry_stack);
+        throw;
+    }
+    return Execute(entry_frames, entry_stack);
+}
+
+// Runs until the frames above entry_frames return.
+Object* VirtualMachine::Execute(size_t entry_frames, size_t entry_stack) {
+    try {
+        while (true) {
+            auto& frame = frames_.back();
+            if (frame.prototype->native != nullptr && jit_enabled_) {
+                RunNative(&frame);
+            }
+            auto instruction = frame.prototype->code[frame.pc++];
+            switch (instruction.code) {
+                case OpCode::Constant:
+                    stack_.push_back(frame.prototype->GetConstants()[instruction.arg]);
+                    break;
+                case OpCode::Folded: {
+                    auto folded = static_cast<FoldedNode*>(
+                        frame.prototype->GetConstants()[instruction.arg]);
+                    if (folded->Holds()) {
+                        stack_.push_back(folded->value);
+                    } else {
+                        ++frame.pc;
+                    }
+                    break;
+                }
+                case OpCode::Nil:
+                    stack_.push_back(nullptr);
+                    break;
+                case OpCode::LoadLocal: {
+                    auto value = stack_[frame.base + instruction.arg];
+                    stack_.push_back(value);
+                    break;
+                }
+                case OpCode::LoadLocalChecked: {
+                    auto value = stack_[frame.base + instruction.arg];
+                    if (value == Unbound()) {
+                        ThrowUnbound(frame.prototype->locals[instruction.arg]);
+                    }
+                    stack_.push_back(value);
+                    break;
+                }
+                case OpCode::LoadBoxed: {
+                    auto value = AsBox(stack_[frame.base + instruction.arg])->Get();
+                    if (value == Unbound()) {
+                        ThrowUnbound(frame.prototype->locals[instruction.arg]);
+                    }
+                    stack_.push_back(value);
+                    break;
+                }
+                case OpCode::DefineLocal:
+                    stack_[frame.base + instruction.arg] = stack_.back();
+                    stack_.back() = Unspecified();
+                    break;
+                case OpCode::DefineBoxed:
+                    AsBox(stack_[frame.base + instruction.arg])->Set(stack_.back());
+                    stack_.back() = Unspecified();
+                    break;
+                case OpCode::StoreLocal:
+                    stack_[frame.base + instruction.arg] = stack_.back();
+                    stack_.pop_back();
+                    break;
+                case OpCode::ClearLocal:
+                    ClearLocal(frame, instruction.arg);
+                    break;
+                case OpCode::SetLocal: {
+                    auto& slot = stack_[frame.base + instruction.arg];
+                    if (slot == Unbound()) {
+                        ThrowUnbound(frame.prototype->locals[instruction.arg]);
+                    }
+                    slot = stack_.back();
+                    stack_.back() = Unspecified();
+                    break;
+                }
+                case OpCode::SetBoxed: {
+                    auto box = AsBox(stack_[frame.base + instruction.arg]);
+                    if (box->Get() == Unbound()) {
+                        ThrowUnbound(frame.prototype->locals[instruction.arg]);
+                    }
+                    box->Set(stack_.back());
+                    stack_.back() = Unspecified();
+                    break;
+                }
+                case OpCode::LoadCapture:
+                    stack_.push_back(frame.closure->GetCapture(instruction.arg));
+                    break;
+                case OpCode::LoadCaptureBoxed: {
+                    auto value = AsBox(frame.closure->GetCapture(instruction.arg))->Get();
+                    if (value == Unbound()) {
+                        ThrowUnbound(frame.prototype->captures[instruction.arg].name);
+                    }
+                    stack_.push_back(value);
+                    break;
+                }
+                case OpCode::SetCaptureBoxed: {
+                    auto box = AsBox(frame.closure->GetCapture(instruction.arg));
+                    if (box->Get() == Unbound()) {
+                        ThrowUnbound(frame.prototype->captures[instruction.arg].name);
+                    }
+                    box->Set(stack_.back());
+                    stack_.back() = Unspecified();
+                    break;
+                }
+                case OpCode::LoadGlobal: {
+                    auto binding = frame.prototype->bindings[instruction.arg];
+                    if (binding->value == Unbound()) {
+                        ThrowUnbound(binding->name);
+                    }
+                    stack_.push_back(binding->value);
+                    break;
+                }
+                case OpCode::DefineGlobal:
+                    globals_->SetValue(frame.prototype->bindings[instruction.arg], stack_.back());
+                    stack_.back() = Unspecified();
+                    break;
+                case OpCode::SetGlobal: {
+                    auto binding = frame.prototype->bindings[instruction.arg];
+                    if (binding->value == Unbound()) {
+                        ThrowUnbound(binding->name);
+                    }
+                    globals_->SetValue(binding, stack_.back());
+                    stack_.back() = Unspecified();
+                    break;
+                }
+                case OpCode::Pop:
+                    stack_.pop_back();
+                    break;
+                case OpCode::Jump:
+                    frame.pc = instruction.arg;
+                    break;
+                case OpCode::Loop:
+                    // safe point, like calls
+                    if (heap->ShouldCollect()) {
+                        heap->DeleteUnuse();
+                    }
+                    if (jit_enabled_ && ++frame.prototype->call_count == kJitThreshold) {
+                        frame.prototype->native = CompileNative(frame.prototype);
+                    }
+                    frame.pc = instruction.arg;
+                    break;
+                case OpCode::JumpIfFalse: {
+                    auto value = stack_.back();
+                    stack_.pop_back();
+                    if (!IsTrue(value)) {
+                        frame.pc = instruction.arg;
+                    }
+                    break;
+                }
+                case OpCode::JumpIfFalseOr:
+                    if (!IsTrue(stack_.back())) {
+                        frame.pc = instruction.arg;
+                    } else {
+                        stack_.pop_back();
+                    }
+                    break;
+                case OpCode::JumpIfTrueOr:
+                    if (IsTrue(stack_.back())) {
+                        frame.pc = instruction.arg;
+                    } else {
+                        stack_.pop_back();
+                    }
+                    break;
+                case OpCode::MakeClosure:
+                    stack_.push_back(
+                        MakeClosure(As<Prototype>(frame.prototype->GetConstants()[instruction.arg])));
+                    break;
+                case OpCode::Call:
+                case OpCode::TailCall:
+                    // safe point: everything alive is on the stack or in the frames
+                    if (heap->ShouldCollect()) {
+                        heap->DeleteUnuse();
+                    }
+                    Call(instruction.arg, instruction.code == OpCode::TailCall);
+                    break;
+                case OpCode::ImproperCall: {
+                    auto callee = stack_.back();
+                    if (Is<Function>(callee) || Is<Closure>(callee)) {
+                        throw SyntaxError("improper list can't be interpreted as arguments.");
+                    }
+                    std::string trying_to_call = Interpreter::Convert(callee);
+                    throw RuntimeError("can't call non function / lambda object '" +
+                                       trying_to_call + "'");
+                }
+                case OpCode::Return: {
+                    auto result = stack_.back();
+                    stack_.resize(frame.base - 1);
+                    frames_.pop_back();
+                    if (frames_.size() == entry_frames) {
+                        return result;
+                    }
+                    stack_.push_back(result);
+                    break;
+                }
+            }
+        }
+    } catch (...) {
+        // a nested Execute has already seen the innermost frames
+        if (error_backtrace_.empty()) {
+            error_backtrace_ = Backtrace();
+        }
+        frames_.resize(entry_frames);
+        stack_.resize(entry_stack);
+        throw;
+    }
+}
+
+// Builtins do not use VM frames, so a tail call of a builtin is an ordinary call,
+// whose result is then returned by the following instructions.
+void VirtualMachine::Call(size_t arg_count, bool tail) {
+    auto first = stack_.size() - arg_count;
+    auto callee = stack_[first - 1];
+    if (Is<Closure>(callee)) {
+        CallClosure(As<Closure>(callee), arg_count, tail);
+        return;
+    }
+    if (Is<Function>(callee)) {
+        // arguments stay on the stack during the call
+        auto result = As<Function>(callee)->Call(interpreter_, {stack_.data() + first, arg_count});
+        stack_.resize(first - 1);
+        stack_.push_back(result);
+        return;
+    }
+    std::string trying_to_call = Interpreter::Convert(callee);
+    throw RuntimeError("can't call non function / lambda object '" + trying_to_call + "'");
+}
+
+void VirtualMachine::CallClosure(Closure* closure, size_t arg_count, bool tail) {
+    auto prototype = closure->GetPrototype();
+    auto first = stack_.size() - arg_count;
+    if (prototype->arguments.size() != arg_count) {
+        std::string message =
+            "invalid amount of arguments for lambda function '" + prototype->name + "'. ";
+        message += "Expected " + std::to_string(prototype->arguments.size()) + ", ";
+        message += "but got " + std::to_string(arg_count);
+
+        message += "\nargs:";
+        for (size_t i = first; i < stack_.size(); ++i) {
+            message += " " + Interpreter::Convert(stack_[i]);
+        }
+        throw RuntimeError(message);
+    }
+
+    if (jit_enabled_ && ++prototype->call_count == kJitThreshold) {
+        prototype->native = CompileNative(prototype);
+    }
+
+    if (tail) {
+        auto& caller = frames_.back();
+        std::copy(stack_.begin() + first - 1, stack_.end(), stack_.begin() + caller.base - 1);
+        stack_.resize(caller.base + arg_count);
+        caller = {prototype, closure, 0, caller.base};
+    } else {
+        frames_.push_back({prototype, closure, 0, first});
+    }
+    AllocateLocals();
+}
+
+// Slots after the arguments of the current frame start unbound, boxed slots get their boxes.
+void VirtualMachine::AllocateLocals() {
+    auto& frame = frames_.back();
+    auto& locals = frame.prototype->locals;
+    stack_.resize(frame.base + locals.size(), Unbound());
+    for (size_t slot = 0; slot < locals.size(); ++slot) {
+        if (frame.prototype->boxed[slot]) {
+            stack_[frame.base + slot] = heap->Make<Box>(stack_[frame.base + slot]);
+        }
+    }
+}
+
+void VirtualMachine::ClearLocal(const CallFrame& frame, uint32_t slot) {
+    auto& local = stack_[frame.base + slot];
+    local = frame.prototype->boxed[slot] ? heap->Make<Box>(Unbound()) : Unbound();
+}
+
+Closure* VirtualMachine::MakeClosure(Prototype* prototype) {
+    auto& frame = frames_.back();
+    std::vector<Object*> captures;
+    captures.reserve(prototype->captures.size());
+    for (auto& capture : prototype->captures) {
+        if (capture.local) {
+            captures.push_back(stack_[frame.base + capture.index]);
+        } else {
+            captures.push_back(frame.closure->GetCapture(capture.index));
+        }
+    }
+    return heap->Make<Closure>(prototype, std::move(captures));
+}
+
+// Native code pushes values above the current top without growing the stack,
+// so the stack is extended before and trimmed to the returned top after.
+void VirtualMachine::RunNative(CallFrame* frame) {
+    auto native = frame->prototype->native.get();
+    auto depth = stack_.size();
+    stack_.resize(depth + native->GetMaxDepth());
+    auto [top, pc] = native->Run(this, stack_.data() + frame->base, stack_.data() + depth,
+                                 frame->pc);
+    stack_.resize(top - stack_.data());
+    frame->pc = pc;
+}
+
+Object** VirtualMachine::NativeStep(VirtualMachine* vm, Object** top, uint32_t pc) {
+    auto& frame = vm->frames_.back();
+    auto instruction = frame.prototype->code[pc];
+    auto locals = vm->stack_.data() + frame.base;
+    switch (instruction.code) {
+        case OpCode::Folded: {
+            auto folded =
+                static_cast<FoldedNode*>(frame.prototype->GetConstants()[instruction.arg]);
+            if (folded->Holds()) {
+                *top++ = folded->value;
+            }
+            return top;
+        }
+        case OpCode::LoadBoxed: {
+            auto value = AsBox(locals[instruction.arg])->Get();
+            if (value == Unbound()) {
+                return nullptr;
+            }
+            *top++ = value;
+            return top;
+        }
+        case OpCode::DefineLocal:
+            locals[instruction.arg] = top[-1];
+            break;
+        case OpCode::DefineBoxed:
+            AsBox(locals[instruction.arg])->Set(top[-1]);
+            break;
+        case OpCode::SetLocal:
+            if (locals[instruction.arg] == Unbound()) {
+                return nullptr;
+            }
+            locals[instruction.arg] = top[-1];
+            break;
+        case OpCode::SetBoxed: {
+            auto box = AsBox(locals[instruction.arg]);
+            if (box->Get() == Unbound()) {
+                return nullptr;
+            }
+            box->Set(top[-1]);
+            break;
+        }
+        case OpCode::LoadCapture:
+            *top++ = frame.closure->GetCapture(instruction.arg);
+            return top;
+        case OpCode::LoadCaptureBoxed: {
+            auto value = AsBox(frame.closure->GetCapture(instruction.arg))->Get();
+            if (value == Unbound()) {
+                return nullptr;
+            }
+            *top++ = value;
+            return top;
+        }
+        case OpCode::SetCaptureBoxed: {
+            auto box = AsBox(frame.closure->GetCapture(instruction.arg));
+            if (box->Get() == Unbound()) {
+                return nullptr;
+            }
+            box->Set(top[-1]);
+            break;
+        }
+        case OpCode::DefineGlobal:
+            vm->globals_->SetValue(frame.prototype->bindings[instruction.arg], top[-1]);
+            break;
+        case OpCode::SetGlobal: {
+            auto binding = frame.prototype->bindings[instruction.arg];
+            if (binding->value == Unbound()) {
+                return nullptr;
+            }
+            vm->globals_->SetValue(binding, top[-1]);
+            break;
+        }
+        case OpCode::MakeClosure: {
+            auto prototype = As<Prototype>(frame.prototype->GetConstants()[instruction.arg]);
+            *top++ = vm->MakeClosure(prototype);
+            return top;
+        }
+        case OpCode::ClearLocal:
+            vm->ClearLocal(frame, instruction.arg);
+            return top;
+        default:
+            return nullptr;
+    }
+    // definitions and assignments leave an empty value
+    top[-1] = Unspecified();
+    return top;
+}
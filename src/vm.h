@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "heap.h"
+#include "object.h"
+
+class Interpreter;
+
+class VirtualMachine : public RootProvider {
+public:
+    explicit VirtualMachine(Interpreter* interpreter);
+    ~VirtualMachine() override;
+
+    Object* Run(Prototype* prototype, Scope* globals);
+    // Calls a closure or a builtin from a builtin, during Run.
+    // The arguments must not point into the VM stack.
+    Object* Apply(Object* callee, const ArgsType& arguments);
+
+    // Names of the active lambdas, innermost first. Frames replaced by tail calls are not listed.
+    std::vector<std::string> Backtrace() const;
+    // Backtrace at the moment the last failed Run threw.
+    const std::vector<std::string>& GetErrorBacktrace() const;
+
+    // Hot prototypes are compiled to native code, where it is supported.
+    void SetJitEnabled(bool enabled);
+    // Executes the instruction at pc of the current frame for native code, that keeps the top
+    // of the stack in a register. Returns the new top, or nullptr if the instruction fails and
+    // has to be executed by the interpreter to report the error.
+    static Object** NativeStep(VirtualMachine* vm, Object** top, uint32_t pc);
+
+    void CollectRoots(std::vector<Object*>* roots) const override;
+
+private:
+    // Locals of the call are stack_[base...], the callee is below them.
+    struct CallFrame {
+        Prototype* prototype;
+        Closure* closure;
+        size_t pc;
+        size_t base;
+    };
+
+    Object* Execute(size_t entry_frames, size_t entry_stack);
+    void Call(size_t arg_count, bool tail);
+    void CallClosure(Closure* closure, size_t arg_count, bool tail);
+    void AllocateLocals();
+    void ClearLocal(const CallFrame& frame, uint32_t slot);
+    void RunNative(CallFrame* frame);
+    Closure* MakeClosure(Prototype* prototype);
+
+    Interpreter* interpreter_;
+    Scope* globals_ = nullptr;
+    bool jit_enabled_ = true;
+    std::vector<Object*> stack_;
+    std::vector<CallFrame> frames_;
+    std::vector<std::string> error_backtrace_;
+};
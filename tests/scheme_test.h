@@ -1,27 +1,57 @@
 #include <catch.hpp>
+#include <memory>
+#include <vector>
 #include "error.h"
 #include "scheme.h"
 
+// Every expectation is checked against all evaluators, so they stay interchangeable.
 class SchemeTest {
 public:
+    SchemeTest() {
+        for (auto evaluator : {EvaluatorType::Bytecode, EvaluatorType::TreeWalking}) {
+            interpreters_.push_back(std::make_unique<Interpreter>(evaluator));
+        }
+    }
     void ExpectOutput(const std::string& input, const std::string expect_output) {
         CAPTURE(input);
-        const std::string& current_output = interpreter_.Run(input);
-        REQUIRE(current_output == expect_output);
+        for (auto& interpreter : interpreters_) {
+            CAPTURE(EvaluatorName(interpreter.get()));
+            const std::string& current_output = interpreter->Run(input);
+            REQUIRE(current_output == expect_output);
+        }
     }
     void ExpectSyntaxError(const std::string& input) {
         CAPTURE(input);
-        REQUIRE_THROWS_AS(interpreter_.Run(input), SyntaxError);
+        for (auto& interpreter : interpreters_) {
+            CAPTURE(EvaluatorName(interpreter.get()));
+            REQUIRE_THROWS_AS(interpreter->Run(input), SyntaxError);
+        }
     }
     void ExpectRuntimeError(const std::string& input) {
         CAPTURE(input);
-        REQUIRE_THROWS_AS(interpreter_.Run(input), RuntimeError);
+        for (auto& interpreter : interpreters_) {
+            CAPTURE(EvaluatorName(interpreter.get()));
+            REQUIRE_THROWS_AS(interpreter->Run(input), RuntimeError);
+        }
     }
     void ExpectNameError(const std::string& input) {
         CAPTURE(input);
-        REQUIRE_THROWS_AS(interpreter_.Run(input), NameError);
+        for (auto& interpreter : interpreters_) {
+            CAPTURE(EvaluatorName(interpreter.get()));
+            REQUIRE_THROWS_AS(interpreter->Run(input), NameError);
+        }
     }
 
 private:
-    Interpreter interpreter_;
+    static std::string EvaluatorName(Interpreter* interpreter) {
+        switch (interpreter->GetEvaluator()) {
+            case EvaluatorType::TreeWalking:
+                return "tree walking";
+            case EvaluatorType::Bytecode:
+                return "bytecode";
+        }
+        return "unknown";
+    }
+
+    std::vector<std::unique_ptr<Interpreter>> interpreters_;
 };
@@ -1,3 +1,660 @@
 #include <catch.hpp>
+#include <string>
+#include "heap.h"
 #include "scheme.h"
 
+#include "catch.hpp"
+#include "scheme_test.h"
+
+TEST_CASE_METHOD(SchemeTest, "If", "[advanced]") {
+    ExpectOutput("(if #t 1 2)", "1");
+    ExpectOutput("(if #f 1 2)", "2");
+    ExpectOutput("(if 0 1 2)", "1");
+    ExpectOutput("(if (> 2 1) (+ 1 1) unknown-symbol)", "2");
+    ExpectOutput("(if #f 1)", "()");
+    ExpectSyntaxError("(if)");
+    ExpectSyntaxError("(if #t)");
+    ExpectSyntaxError("(if #t 1 2 3)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Variables", "[advanced]") {
+    ExpectOutput("(define x 1)", "");
+    ExpectOutput("x", "1");
+    ExpectOutput("(set! x (+ x 1))", "");
+    ExpectOutput("x", "2");
+    ExpectOutput("(define l '())", "");
+    ExpectOutput("l", "()");
+    ExpectNameError("y");
+    ExpectNameError("(set! y 1)");
+    ExpectSyntaxError("(define)");
+    ExpectSyntaxError("(define x)");
+    ExpectSyntaxError("(define x 1 2)");
+    ExpectSyntaxError("(set! x)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Pair mutation", "[advanced]") {
+    ExpectOutput("(define p (cons 1 2))", "");
+    ExpectOutput("(set-car! p 3)", "");
+    ExpectOutput("p", "(3 . 2)");
+    ExpectOutput("(set-cdr! p '(4))", "");
+    ExpectOutput("p", "(3 4)");
+    ExpectRuntimeError("(set-car! 1 2)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Lambda", "[advanced]") {
+    ExpectOutput("((lambda (x) (+ x 1)) 5)", "6");
+    ExpectOutput("((lambda () 1))", "1");
+    ExpectOutput("((lambda (x y) (set! x (* x y)) (+ x 1)) 2 3)", "7");
+    ExpectOutput("(define (inc x) (+ x 1))", "");
+    ExpectOutput("(inc 41)", "42");
+    ExpectRuntimeError("(inc)");
+    ExpectRuntimeError("(inc 1 2)");
+    ExpectSyntaxError("(lambda (x))");
+    ExpectRuntimeError("(1 2)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Recursion", "[advanced]") {
+    ExpectOutput("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", "");
+    ExpectOutput("(fib 20)", "6765");
+    ExpectOutput("(define (len l) (if (null? l) 0 (+ 1 (len (cdr l)))))", "");
+    ExpectOutput("(len '(1 2 3 4 5))", "5");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Closures", "[advanced]") {
+    ExpectOutput("(define range (lambda (x) (lambda () (set! x (+ x 1)) x)))", "");
+    ExpectOutput("(define my-range (range 10))", "");
+    ExpectOutput("(my-range)", "11");
+    ExpectOutput("(my-range)", "12");
+    ExpectOutput("(define other-range (range 20))", "");
+    ExpectOutput("(other-range)", "21");
+    ExpectOutput("(my-range)", "13");
+
+    ExpectOutput("(define (adder n) (lambda (x) (+ x n)))", "");
+    ExpectOutput("((adder 3) 4)", "7");
+    ExpectOutput("(define (outer) (define y 5) (lambda () y))", "");
+    ExpectOutput("((outer))", "5");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Short circuit", "[advanced]") {
+    ExpectOutput("(define x 0)", "");
+    ExpectOutput("(and (set! x 1) #f (set! x 2))", "#f");
+    ExpectOutput("x", "1");
+    ExpectOutput("(or (set! x 3) (set! x 4))", "");
+    ExpectOutput("x", "3");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Lexical scoping", "[advanced]") {
+    ExpectOutput("(define x 1)", "");
+    ExpectOutput("(define (shadow x) (+ x 10))", "");
+    ExpectOutput("(shadow 5)", "15");
+    ExpectOutput("x", "1");
+
+    ExpectOutput("(define (curry a) (lambda (b) (lambda (c) (list a b c))))", "");
+    ExpectOutput("(((curry 1) 2) 3)", "(1 2 3)");
+
+    ExpectOutput("(define (later) (defined-later 1))", "");
+    ExpectNameError("(later)");
+    ExpectOutput("(define (defined-later y) (* y 2))", "");
+    ExpectOutput("(later)", "2");
+
+    ExpectOutput("(define (internal n) (define (twice k) (* k 2)) (define m (twice n)) (+ m 1))",
+                 "");
+    ExpectOutput("(internal 4)", "9");
+    ExpectOutput("(define (set-outer v) (set! x v))", "");
+    ExpectOutput("(set-outer 7)", "");
+    ExpectOutput("x", "7");
+}
+
+TEST_CASE("Lambda body is not copied on call", "[advanced]") {
+    for (auto evaluator : {EvaluatorType::Bytecode, EvaluatorType::TreeWalking}) {
+        Interpreter interpreter(evaluator);
+        std::string body = "'(";
+        for (int i = 0; i < 100; ++i) {
+            body += " " + std::to_string(i);
+        }
+        body += ")";
+        interpreter.Run("(define (f) " + body + " 1)");
+
+        auto before = Heap::alloc_count;
+        REQUIRE(interpreter.Run("(f)") == "1");
+        REQUIRE(Heap::alloc_count - before < 20);
+    }
+}
+
+TEST_CASE_METHOD(SchemeTest, "Tail calls", "[advanced]") {
+    ExpectOutput("(define (count n) (if (= n 0) 'done (count (- n 1))))", "");
+    ExpectOutput("(count 100000)", "done");
+    ExpectOutput("(define (even? n) (or (= n 0) (and (> n 0) (odd? (- n 1)))))", "");
+    ExpectOutput("(define (odd? n) (and (not (= n 0)) (even? (- n 1))))", "");
+    ExpectOutput("(even? 100000)", "#t");
+    ExpectOutput("(odd? 100001)", "#t");
+    ExpectOutput("(define (sum n acc) (if (= n 0) acc ((lambda () (sum (- n 1) (+ acc n))))))", "");
+    ExpectOutput("(sum 100000 0)", "5000050000");
+}
+
+TEST_CASE("Deep recursion does not use the native stack", "[advanced]") {
+    Interpreter interpreter(EvaluatorType::Bytecode);
+    interpreter.Run("(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))");
+    interpreter.Run("(define (len l) (if (null? l) 0 (+ 1 (len (cdr l)))))");
+    REQUIRE(interpreter.Run("(len (build 200000 '()))") == "200000");
+}
+
+TEST_CASE("Backtrace of a failed call", "[advanced]") {
+    Interpreter interpreter(EvaluatorType::Bytecode);
+    interpreter.Run("(define (fail x) (car x) 1)");
+    interpreter.Run("(define (outer x) (+ (fail x) 1))");
+    REQUIRE_THROWS_AS(interpreter.Run("(outer 5)"), RuntimeError);
+    auto backtrace = interpreter.GetBacktrace();
+    // the call of outer is in tail position, so it replaced the top level frame
+    REQUIRE(backtrace.size() == 2);
+    REQUIRE(backtrace[0] == "lambda_0");
+    REQUIRE(backtrace[1] == "lambda_1");
+
+    REQUIRE(interpreter.Run("(outer '(1))") == "2");
+    REQUIRE(interpreter.GetBacktrace().empty());
+}
+
+TEST_CASE("Closures keep only captured variables", "[advanced]") {
+    Interpreter interpreter(EvaluatorType::Bytecode);
+    interpreter.Run("(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))");
+    interpreter.Run("(define (make n) (define big (build 10000 '())) (lambda () n))");
+
+    auto live_before = Heap::alloc_count - Heap::dealloc_count;
+    interpreter.Run("(define keep (make 5))");
+    REQUIRE(Heap::alloc_count - Heap::dealloc_count - live_before < 100);
+    REQUIRE(interpreter.Run("(keep)") == "5");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Global redefinition", "[advanced]") {
+    ExpectOutput("(define (g) 1)", "");
+    ExpectOutput("(define (call-g) (g))", "");
+    ExpectOutput("(call-g)", "1");
+    ExpectOutput("(define (g) 2)", "");
+    ExpectOutput("(call-g)", "2");
+    ExpectOutput("(set! g (lambda () 3))", "");
+    ExpectOutput("(call-g)", "3");
+
+    ExpectOutput("(define (use-car l) (car l))", "");
+    ExpectOutput("(use-car '(1 2))", "1");
+    ExpectOutput("(define (shadow-car car) (car 5))", "");
+    ExpectOutput("(shadow-car (lambda (x) (* x 2)))", "10");
+    ExpectOutput("(use-car '(1 2))", "1");
+    ExpectOutput("(define (local-car) (define (car x) x) (car 7))", "");
+    ExpectOutput("(local-car)", "7");
+    ExpectOutput("(use-car '(3 4))", "3");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Special forms are checked before evaluation", "[advanced]") {
+    ExpectSyntaxError("(define (never) (if #t))");
+    ExpectNameError("(never)");
+    ExpectSyntaxError("(define (never) (lambda (x)))");
+    ExpectRuntimeError("(define (never) (quote))");
+    ExpectOutput("(and)", "#t");
+    ExpectOutput("(or)", "#f");
+    ExpectNameError("if");
+    ExpectOutput("(define (keyword if) (if if 1 2))", "");
+    ExpectOutput("(keyword #f)", "2");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Call sites survive changing callees", "[advanced]") {
+    ExpectOutput("(define (less a b) (< a b))", "");
+    ExpectOutput("(less 1 2)", "#t");
+    ExpectRuntimeError("(less 1 'x)");
+    ExpectOutput("(less 3 2)", "#f");
+
+    ExpectOutput("(define (apply2 f a b) (f a b))", "");
+    ExpectOutput("(apply2 + 2 3)", "5");
+    ExpectOutput("(apply2 - 2 3)", "-1");
+    ExpectOutput("(apply2 (lambda (x y) (* x y)) 2 3)", "6");
+    ExpectOutput("(apply2 cons 2 3)", "(2 . 3)");
+    ExpectRuntimeError("(apply2 1 2 3)");
+
+    ExpectOutput("(define (add a b) (+ a b))", "");
+    ExpectOutput("(add 2 3)", "5");
+    ExpectOutput("(define (+ a b) (* a b))", "");
+    ExpectOutput("(add 2 3)", "6");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Constant expressions are folded", "[advanced]") {
+    ExpectOutput("(* 60 60 24)", "86400");
+    ExpectOutput("(define (day) (* 60 (* 60 24)))", "");
+    ExpectOutput("(day)", "86400");
+    ExpectOutput("(define (second) (car (cdr '(1 2 3))))", "");
+    ExpectOutput("(second)", "2");
+
+    ExpectOutput("(define (never) (/ 1 0))", "");
+    ExpectRuntimeError("(never)");
+    ExpectOutput("(define (shadow *) (* 2 3))", "");
+    ExpectOutput("(shadow +)", "5");
+
+    ExpectOutput("(define (* a b) (+ a b))", "");
+    ExpectOutput("(day)", "144");
+    ExpectOutput("(* 60 60)", "120");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Hot lambdas keep their behaviour", "[advanced]") {
+    ExpectOutput("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", "");
+    ExpectOutput("(fib 20)", "6765");
+
+    ExpectOutput(
+        "(define (work n) (define x (* 2 3)) (set! x (+ x n)) (define (get) x)"
+        " (if (and (> n 0) (or #f (< n 100000))) (get) 'negative))",
+        "");
+    ExpectOutput("(define (run n acc) (if (= n 0) acc (run (- n 1) (+ acc (work n)))))", "");
+    ExpectOutput("(run 3000 0)", "4519500");
+    ExpectOutput("(work -1)", "negative");
+
+    ExpectOutput("(define (maybe flag) (if flag undefined-name (car '(1))))", "");
+    ExpectOutput("(define (repeat n) (if (= n 0) (maybe #f) (begin-loop n)))", "");
+    ExpectOutput("(define (begin-loop n) (maybe #f) (repeat (- n 1)))", "");
+    ExpectOutput("(repeat 2000)", "1");
+    ExpectNameError("(maybe #t)");
+
+    ExpectOutput("(define (add a b) (+ a b))", "");
+    ExpectOutput("(define (sum n) (if (= n 0) 0 (add n (sum (- n 1)))))", "");
+    ExpectOutput("(sum 2000)", "2001000");
+    ExpectRuntimeError("(add 1 'x)");
+    ExpectOutput("(define (+ a b) (- a b))", "");
+    ExpectOutput("(add 5 3)", "2");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Scopes of finished calls do not leak", "[advanced]") {
+    ExpectOutput("(define (probe flag) (if flag (define seen 1) 0) seen)", "");
+    ExpectOutput("(probe #t)", "1");
+    ExpectNameError("(probe #f)");
+
+    ExpectOutput("(define (make-adder n) (lambda (x) (+ x n)))", "");
+    ExpectOutput("(define (twice x) (define y (* x 2)) y)", "");
+    ExpectOutput("(define add-one (make-adder 1))", "");
+    ExpectOutput("(twice 5)", "10");
+    ExpectOutput("(add-one (twice 2))", "5");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Memoization", "[advanced]") {
+    ExpectOutput("(define-memoized (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", "");
+    ExpectOutput("(fib 80)", "23416728348467685");
+    ExpectOutput("(define square (memoize (lambda (x) (* x x)) 2))", "");
+    ExpectOutput("(square 1)", "1");
+    ExpectOutput("(square 2)", "4");
+    ExpectOutput("(square 3)", "9");
+    ExpectOutput("(square 1)", "1");
+    ExpectOutput("(define-memoized (local-set n) (define acc 1) (set! acc (+ acc n)) acc)", "");
+    ExpectOutput("(local-set 4)", "5");
+
+    ExpectOutput("(define first (memoize car))", "");
+    ExpectOutput("(define l (list 1 2))", "");
+    ExpectOutput("(first l)", "1");
+    ExpectOutput("(set-car! l 5)", "");
+    ExpectOutput("(first l)", "5");
+
+    ExpectOutput("(define counter 0)", "");
+    ExpectSyntaxError("(define-memoized (bump x) (set! counter x) x)");
+    ExpectSyntaxError("(define-memoized bump 1)");
+    ExpectRuntimeError("(memoize (lambda (p) (set-car! p 1)))");
+    ExpectRuntimeError("(memoize cons)");
+
+    ExpectOutput("(define (bump) (set! counter (+ counter 1)) counter)", "");
+    ExpectRuntimeError("(define-memoized (h x) (+ x (bump)))");
+    ExpectRuntimeError("(memoize (lambda (x) (+ x (bump))))");
+    ExpectOutput("(define (indirect) (bump))", "");
+    ExpectRuntimeError("(memoize (lambda (x) (+ x (indirect))))");
+    ExpectOutput("(define (make-counted) (define (step) (bump)) (lambda (x) (+ x (step))))", "");
+    ExpectRuntimeError("(memoize (make-counted))");
+    ExpectRuntimeError("(memoize (lambda (p) (let ((f set-car!)) (f p 1))))");
+    ExpectRuntimeError("(memoize (lambda (f x) (f x)))");
+    ExpectOutput("counter", "0");
+    ExpectOutput("(define (double x) (* x 2))", "");
+    ExpectOutput("(define-memoized (quad x) (double (double x)))", "");
+    ExpectOutput("(quad 3)", "12");
+    ExpectRuntimeError("(memoize 1)");
+    ExpectRuntimeError("(memoize car 0)");
+    ExpectRuntimeError("(fib 1 2)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Let forms", "[advanced]") {
+    ExpectOutput("(let ((x 1) (y 2)) (+ x y))", "3");
+    ExpectOutput("(let () 5)", "5");
+    ExpectOutput("(define x 10)", "");
+    ExpectOutput("(let ((x 1) (y x)) y)", "10");
+    ExpectOutput("(let* ((x 1) (y x)) y)", "1");
+    ExpectOutput("(let* ((x 1) (x (+ x 1))) x)", "2");
+    ExpectOutput("x", "10");
+
+    ExpectOutput("(define (f x) (let ((x (* x 2)) (y x)) (list x y)))", "");
+    ExpectOutput("(f 3)", "(6 3)");
+    ExpectOutput("(define (g n) (let ((m (+ n 1))) (if (= n 0) m (g (- n 1)))))", "");
+    ExpectOutput("(g 5000)", "1");
+    ExpectOutput("(define (h n) (+ (let ((a n)) a) (let ((b (* n n))) b)))", "");
+    ExpectOutput("(h 3)", "12");
+
+    ExpectOutput(
+        "(letrec ((even? (lambda (n) (if (= n 0) #t (odd? (- n 1)))))"
+        " (odd? (lambda (n) (if (= n 0) #f (even? (- n 1))))))"
+        " (even? 1001))",
+        "#f");
+    ExpectNameError("(letrec ((a b) (b 1)) a)");
+
+    ExpectOutput("(define (make-counter) (let ((n 0)) (lambda () (set! n (+ n 1)) n)))", "");
+    ExpectOutput("(define c (make-counter))", "");
+    ExpectOutput("(c)", "1");
+    ExpectOutput("(c)", "2");
+    ExpectOutput("((make-counter))", "1");
+    ExpectOutput("(define adders (let ((a 1)) (list (lambda (x) (+ x a)) (let ((a 2)) a))))", "");
+    ExpectOutput("((car adders) 5)", "6");
+
+    ExpectOutput("(let ((y 1)) (define z (+ y 1)) (set! y z) (list y z))", "(2 2)");
+    ExpectNameError("z");
+    ExpectOutput("(define (k) (let ((p 1)) (define q 2) (+ p q)))", "");
+    ExpectOutput("(k)", "3");
+
+    ExpectSyntaxError("(let ((x 1) (x 2)) x)");
+    ExpectSyntaxError("(let ((x)) x)");
+    ExpectSyntaxError("(let (x 1) x)");
+    ExpectSyntaxError("(let x)");
+    ExpectSyntaxError("(letrec ((1 2)) 1)");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Loops", "[advanced]") {
+    ExpectOutput("(let loop ((i 0) (acc 0)) (if (= i 100000) acc (loop (+ i 1) (+ acc 2))))",
+                 "200000");
+    ExpectOutput("(define (count n) (let loop ((i 0)) (if (< i n) (loop (+ i 1)) i)))", "");
+    ExpectOutput("(count 5000)", "5000");
+    ExpectOutput("(count 0)", "0");
+    ExpectOutput("(let fact ((n 5)) (if (= n 0) 1 (* n (fact (- n 1)))))", "120");
+    ExpectOutput("(let down ((n 3)) (if (= n 0) 'done (let ((m (- n 1))) (down m))))", "done");
+    ExpectOutput("(let ((f (let self ((n 0)) (if (= n 0) self n)))) (f 7))", "7");
+
+    ExpectOutput(
+        "(define fs (let loop ((i 0) (acc '()))"
+        " (if (= i 3) acc (loop (+ i 1) (cons (lambda () i) acc)))))",
+        "");
+    ExpectOutput("((car fs))", "2");
+    ExpectOutput("((car (cdr (cdr fs))))", "0");
+    ExpectOutput(
+        "(define gs (let loop ((i 0) (acc '()))"
+        " (if (= i 2) acc (loop (+ i 1) (cons (lambda () (set! i (+ i 10)) i) acc)))))",
+        "");
+    ExpectOutput("((car gs))", "11");
+    ExpectOutput("((car gs))", "21");
+    ExpectOutput("((car (cdr gs)))", "10");
+
+    ExpectOutput("(do ((i 0 (+ i 1)) (acc 0 (+ acc i))) ((= i 5) acc))", "10");
+    ExpectOutput("(define v 0)", "");
+    ExpectOutput("(do ((i 0 (+ i 1))) ((= i 4)) (set! v (+ v i)) (set! v (* v 2)))", "");
+    ExpectOutput("v", "22");
+    ExpectOutput("(do ((p '(1 2 3)) (n 0)) ((null? p) n) (set! n (+ n (car p))) (set! p (cdr p)))",
+                 "6");
+    ExpectOutput(
+        "(do ((i 0 (+ i 1)) (s 0 (+ s (do ((j 0 (+ j 1)) (t 0 (+ t j))) ((= j i) t)))))"
+        " ((= i 4) s))",
+        "4");
+
+    ExpectSyntaxError("(let loop)");
+    ExpectSyntaxError("(let loop ((i 0)))");
+    ExpectSyntaxError("(do)");
+    ExpectSyntaxError("(do ((i 0)) ())");
+    ExpectSyntaxError("(do ((i 0 1 2)) (#t))");
+    ExpectSyntaxError("(do ((i 0) (i 1)) (#t))");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Numbers out of the fixnum range", "[advanced]") {
+    ExpectOutput("(+ 4611686018427387903 1)", "4611686018427387904");
+    ExpectOutput("(- -4611686018427387904 1)", "-4611686018427387905");
+    ExpectOutput("(* 3037000499 3037000499)", "9223372030926249001");
+    ExpectOutput("(- (+ 4611686018427387903 1) 1)", "4611686018427387903");
+    ExpectOutput("(= (- 4611686018427387904 1) 4611686018427387903)", "#t");
+    ExpectOutput("(< 4611686018427387903 4611686018427387904)", "#t");
+    ExpectOutput("(number? 9223372036854775807)", "#t");
+    ExpectOutput("(list 1 4611686018427387904)", "(1 4611686018427387904)");
+
+    ExpectOutput("(define (add a b) (+ a b))", "");
+    ExpectOutput("(define (mul a b) (* a b))", "");
+    ExpectOutput("(define (sub a b) (- a b))", "");
+    ExpectOutput("(define (warm n) (if (= n 0) 0 (begin-warm n)))", "");
+    ExpectOutput("(define (begin-warm n) (add n (mul n (sub n 1))) (warm (- n 1)))", "");
+    ExpectOutput("(warm 2000)", "0");
+    ExpectOutput("(add 4611686018427387903 1)", "4611686018427387904");
+    ExpectOutput("(add -4611686018427387904 -1)", "-4611686018427387905");
+    ExpectOutput("(sub -4611686018427387904 1)", "-4611686018427387905");
+    ExpectOutput("(mul 4611686018427387903 -2)", "-9223372036854775806");
+    ExpectOutput("(mul -2147483648 2147483648)", "-4611686018427387904");
+    ExpectOutput("(add 2 3)", "5");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Big numbers", "[advanced]") {
+    ExpectOutput("100000000000000000000", "100000000000000000000");
+    ExpectOutput("-100000000000000000000", "-100000000000000000000");
+    ExpectOutput("'(1 -9223372036854775809)", "(1 -9223372036854775809)");
+    ExpectOutput("(- 100000000000000000000 1)", "99999999999999999999");
+    ExpectOutput("(+ 9223372036854775807 1)", "9223372036854775808");
+    ExpectOutput("(- -9223372036854775808 1)", "-9223372036854775809");
+    ExpectOutput("(* 4294967296 4294967296 -4294967296)", "-79228162514264337593543950336");
+    ExpectOutput("(/ -100000000000000000000 7)", "-14285714285714285714");
+    ExpectOutput("(/ 100000000000000000000 -100000000000000000000)", "-1");
+    ExpectOutput("(/ 7 100000000000000000000)", "0");
+    ExpectRuntimeError("(/ 100000000000000000000 0)");
+    ExpectOutput("(abs -100000000000000000000)", "100000000000000000000");
+    ExpectOutput("(max 1 100000000000000000000 -100000000000000000000)", "100000000000000000000");
+    ExpectOutput("(min 1 100000000000000000000 -100000000000000000000)", "-100000000000000000000");
+    ExpectOutput("(< -100000000000000000000 1 100000000000000000000)", "#t");
+    ExpectOutput("(> 100000000000000000000 99999999999999999999 1)", "#t");
+    ExpectOutput("(= 100000000000000000000 100000000000000000000)", "#t");
+    ExpectOutput("(= 100000000000000000000 1)", "#f");
+    ExpectOutput("(number? 100000000000000000000)", "#t");
+
+    // results that fit are fixnums again
+    ExpectOutput("(define big 100000000000000000000)", "");
+    ExpectOutput("(- big big)", "0");
+    ExpectOutput("(= (- big (- big 5)) 5)", "#t");
+    ExpectOutput("(list-ref '(1 2 3) (- big (- big 1)))", "2");
+
+    ExpectOutput("(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))", "");
+    ExpectOutput("(fact 30)", "265252859812191058636308480000000");
+    ExpectOutput("(/ (fact 30) (fact 28))", "870");
+
+    // products of more than a thousand bits are computed by Karatsuba multiplication
+    ExpectOutput("(define (pow a n) (if (= n 0) 1 (* a (pow a (- n 1)))))", "");
+    ExpectOutput("(= (* (pow 7 600) (pow 7 600)) (pow 7 1200))", "#t");
+    ExpectOutput("(= (* (pow 3 1000) (pow 7 300)) (* (pow 7 300) (pow 3 1000)))", "#t");
+    ExpectOutput("(= (/ (pow 7 1200) (pow 7 599)) (pow 7 601))", "#t");
+    ExpectOutput("(= (/ (- (pow 7 1200) 1) (pow 7 599)) (pow 7 601))", "#f");
+    ExpectOutput("(* (pow 10 400) (pow 10 400))", "1" + std::string(800, '0'));
+    ExpectOutput("(- (pow 2 2048) (pow 2 2048))", "0");
+
+    ExpectOutput("(define (square x) (* x x))", "");
+    ExpectOutput("(define (less a b) (< a b))", "");
+    ExpectOutput("(define (warm n) (square n) (less n 1) (if (= n 0) 0 (warm (- n 1))))", "");
+    ExpectOutput("(warm 2000)", "0");
+    ExpectOutput("(square 10000000000)", "100000000000000000000");
+    ExpectOutput("(square big)", "10000000000000000000000000000000000000000");
+    ExpectOutput("(less big 1)", "#f");
+    ExpectOutput("(less 1 big)", "#t");
+    ExpectOutput("(square 3)", "9");
+
+    ExpectOutput("(define slow-pow (memoize pow))", "");
+    ExpectOutput("(= (slow-pow big 3) (slow-pow 100000000000000000000 3))", "#t");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Shared booleans", "[advanced]") {
+    ExpectOutput("(if '#f 1 2)", "2");
+    ExpectOutput("(if (car '(#f)) 1 2)", "2");
+    ExpectOutput("(boolean? '#t)", "#t");
+    ExpectOutput("(boolean? (car '(#f #t)))", "#t");
+    ExpectOutput("(boolean? 'f)", "#f");
+    ExpectOutput("(not (< 2 1))", "#t");
+    ExpectOutput("(and 1 (> 1 2) 3)", "#f");
+    ExpectOutput("(or #f (> 2 1))", "#t");
+
+    ExpectOutput("(define (less a b) (< a b))", "");
+    ExpectOutput("(define (count n k) (if (less 0 n) (count (- n 1) (+ k 1)) k))", "");
+    ExpectOutput("(count 3000 0)", "3000");
+    ExpectOutput("(if (less 2 1) 1 2)", "2");
+    ExpectOutput("(boolean? (less 1 2))", "#t");
+    ExpectOutput("(define x 1)", "");
+    ExpectOutput("(set! x 2)", "");
+    ExpectOutput("(do ((i 0 (+ i 1))) ((= i 2)))", "");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Pairs survive collections", "[advanced]") {
+    ExpectOutput("(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))", "");
+    ExpectOutput("(define (sum l acc) (if (null? l) acc (sum (cdr l) (+ acc (car l)))))", "");
+    ExpectOutput("(define xs (range 100000 '()))", "");
+    ExpectOutput("(define ys (range 100000 '()))", "");
+    ExpectOutput("(sum xs 0)", "5000050000");
+    ExpectOutput("(list-ref ys 99999)", "100000");
+
+    ExpectOutput("(define p (cons 1 2))", "");
+    ExpectOutput("(set-car! p (lambda (x) (* x 3)))", "");
+    ExpectOutput("(set-cdr! p (range 3 '()))", "");
+    ExpectOutput("(define zs (range 100000 '()))", "");
+    ExpectOutput("((car p) 5)", "15");
+    ExpectOutput("(cdr p)", "(1 2 3)");
+
+    ExpectOutput("(define up-to (memoize (lambda (n) (range n '()))))", "");
+    ExpectOutput("(up-to 3)", "(1 2 3)");
+    ExpectOutput("(define ws (range 100000 '()))", "");
+    ExpectOutput("(up-to 3)", "(1 2 3)");
+}
+
+TEST_CASE("Dead pairs are reused", "[advanced]") {
+    Interpreter interpreter;
+    interpreter.Run("(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))");
+    interpreter.Run("(define (drop l k) (churn (- k 1)))");
+    interpreter.Run("(define (churn k) (if (= k 0) 'done (drop (range 10000 '()) k)))");
+    interpreter.Run("(churn 10)");
+
+    auto live_before = Heap::alloc_count - Heap::dealloc_count;
+    REQUIRE(interpreter.Run("(churn 30)") == "done");
+    REQUIRE(Heap::alloc_count - Heap::dealloc_count - live_before < 200000);
+}
+
+// A new chunk links only its own cells, so the cells scanned per added chunk do not grow with
+// the size of the cons space: each chunk is scanned once when added and once more by every
+// collection. Rescanning all chunks on growth would scan about half of them per chunk.
+TEST_CASE("Growing the cons space is linear", "[advanced]") {
+    static auto heap = GetHeap();
+    Interpreter interpreter;
+    interpreter.Run("(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))");
+
+    auto chunks_before = heap->GetConsChunkCount();
+    auto scanned_before = Heap::scanned_cells;
+    interpreter.Run("(define xs (range 65536 '()))");
+    auto added = heap->GetConsChunkCount() - chunks_before;
+    auto scanned = Heap::scanned_cells - scanned_before;
+    REQUIRE(added >= 65536 / Heap::GetCellsPerChunk());
+    REQUIRE(scanned <= 5 * added * Heap::GetCellsPerChunk());
+    REQUIRE(interpreter.Run("(list-ref xs 65535)") == "65536");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Vectors", "[advanced]") {
+    ExpectOutput("(vector)", "#()");
+    ExpectOutput("(vector 1 '(2 3) '() 'a)", "#(1 (2 3) () a)");
+    ExpectOutput("(make-vector 3)", "#(0 0 0)");
+    ExpectOutput("(make-vector 2 'x)", "#(x x)");
+    ExpectOutput("(vector-length (make-vector 5))", "5");
+    ExpectOutput("(vector-ref (vector 1 2 3) 2)", "3");
+    ExpectOutput("(list->vector '(1 2 3))", "#(1 2 3)");
+    ExpectOutput("(vector->list (vector 1 2 3))", "(1 2 3)");
+    ExpectOutput("(vector->list (vector))", "()");
+
+    ExpectOutput("(define v (make-vector 3 0))", "");
+    ExpectOutput("(vector-set! v 1 'b)", "");
+    ExpectOutput("v", "#(0 b 0)");
+    ExpectOutput("(vector-fill! v 7)", "");
+    ExpectOutput("v", "#(7 7 7)");
+    ExpectOutput("(define w v)", "");
+    ExpectOutput("(vector-set! w 0 (vector 1))", "");
+    ExpectOutput("v", "#(#(1) 7 7)");
+
+    ExpectRuntimeError("(make-vector -1)");
+    ExpectRuntimeError("(make-vector 'a)");
+    ExpectRuntimeError("(make-vector 100000000000000 0)");
+    ExpectRuntimeError("(make-vector 4611686018427387903)");
+    ExpectRuntimeError("(vector-ref v 3)");
+    ExpectRuntimeError("(vector-ref v -1)");
+    ExpectRuntimeError("(vector-ref v 100000000000000000000)");
+    ExpectRuntimeError("(vector-ref v 'a)");
+    ExpectRuntimeError("(vector-ref '(1 2) 0)");
+    ExpectRuntimeError("(vector-set! v 3 0)");
+    ExpectRuntimeError("(vector-length '(1))");
+    ExpectRuntimeError("(list->vector '(1 . 2))");
+    ExpectRuntimeError("(vector->list '(1))");
+
+    // a vector could change, so calls with one are not cached
+    ExpectOutput("(define first (memoize (lambda (v) (vector-ref v 0))))", "");
+    ExpectOutput("(first v)", "#(1)");
+    ExpectOutput("(vector-set! v 0 2)", "");
+    ExpectOutput("(first v)", "2");
+    ExpectRuntimeError("(memoize (lambda (v) (vector-set! v 0 1)))");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Vectors survive collections", "[advanced]") {
+    ExpectOutput("(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))", "");
+    ExpectOutput("(define v (list->vector (range 100000 '())))", "");
+    ExpectOutput("(define (fill i) (if (= i 1000) 'done (begin-fill i)))", "");
+    ExpectOutput("(define (begin-fill i) (vector-set! v i (range 3 '())) (fill (+ i 1)))", "");
+    ExpectOutput("(fill 0)", "done");
+    ExpectOutput("(define xs (range 100000 '()))", "");
+    ExpectOutput("(define ys (range 100000 '()))", "");
+    ExpectOutput("(vector-ref v 999)", "(1 2 3)");
+    ExpectOutput("(vector-ref v 99999)", "100000");
+    ExpectOutput("(define (sum i acc) "
+                 "(if (= i 100000) acc (sum (+ i 1) (+ acc (vector-ref v i)))))",
+                 "");
+    ExpectOutput("(vector-fill! v 1)", "");
+    ExpectOutput("(sum 0 0)", "100000");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Strings", "[advanced]") {
+    ExpectOutput("\"hello\"", "\"hello\"");
+    ExpectOutput("\"a\\\"b\\\\c\\nd\"", "\"a\\\"b\\\\c\\nd\"");
+    ExpectOutput("'(\"a\" b)", "(\"a\" b)");
+    ExpectOutput("(string? \"a\")", "#t");
+    ExpectOutput("(string? 'a)", "#f");
+    ExpectOutput("(string-length \"\")", "0");
+    ExpectOutput("(string-length \"hello\")", "5");
+    ExpectOutput("(string-append)", "\"\"");
+    ExpectOutput("(string-append \"ab\" \"\" \"cd\")", "\"abcd\"");
+    ExpectOutput("(substring \"hello\" 1 3)", "\"el\"");
+    ExpectOutput("(substring \"hello\" 2)", "\"llo\"");
+    ExpectOutput("(substring \"hello\" 5 5)", "\"\"");
+    ExpectOutput("(string=? \"ab\" \"ab\" (string-append \"a\" \"b\"))", "#t");
+    ExpectOutput("(string=? \"ab\" \"abc\")", "#f");
+    ExpectOutput("(string=? \"ab\" \"ba\")", "#f");
+    ExpectOutput("(string->symbol \"abc\")", "abc");
+    ExpectOutput("(symbol? (string->symbol \"abc\"))", "#t");
+    ExpectOutput("(symbol->string 'abc)", "\"abc\"");
+
+    ExpectRuntimeError("(string-length 'a)");
+    ExpectRuntimeError("(string-append \"a\" 1)");
+    ExpectRuntimeError("(substring \"hello\" 3 2)");
+    ExpectRuntimeError("(substring \"hello\" 0 6)");
+    ExpectRuntimeError("(substring \"hello\" -1)");
+    ExpectRuntimeError("(substring 'hello 1)");
+    ExpectRuntimeError("(string=? \"a\" 'a)");
+    ExpectRuntimeError("(string->symbol 'a)");
+    ExpectRuntimeError("(symbol->string \"a\")");
+    ExpectSyntaxError("\"abc");
+}
+
+TEST_CASE_METHOD(SchemeTest, "Long strings are built as ropes", "[advanced]") {
+    ExpectOutput("(define (build n acc) "
+                 "(if (= n 0) acc (build (- n 1) (string-append acc \"piece-\"))))",
+                 "");
+    ExpectOutput("(define s (build 100000 \"\"))", "");
+    ExpectOutput("(define (range n acc) (if (= n 0) acc (range (- n 1) (cons n acc))))", "");
+    ExpectOutput("(define xs (range 100000 '()))", "");
+    ExpectOutput("(string-length s)", "600000");
+    ExpectOutput("(substring s 599994)", "\"piece-\"");
+    ExpectOutput("(substring s 3 15)", "\"ce-piece-pie\"");
+    ExpectOutput("(string=? s (build 100000 \"\"))", "#t");
+    ExpectOutput("(string=? s (string-append s \"-\"))", "#f");
+
+    ExpectOutput("(define long \"a string longer than the inline buffer\")", "");
+    ExpectOutput("(define twice (string-append long \" and \" long))", "");
+    ExpectOutput("(define ys (range 100000 '()))", "");
+    ExpectOutput("twice",
+                 "\"a string longer than the inline buffer and a string longer than the inline "
+                 "buffer\"");
+    ExpectOutput("(string-length (string-append twice twice))", "162");
+}
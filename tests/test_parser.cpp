@@ -21,7 +21,7 @@ static void RequireSymbol(Object* object, const std::string& name) {
 
 static void RequireNumber(Object* object, const Int& value) {
     REQUIRE(Is<Number>(object));
-    REQUIRE(As<Number>(object)->GetValue() == value);
+    REQUIRE(GetNumberValue(object) == value);
 }
 
 TEST_CASE("Simple objects", "[parser]") {
@@ -42,6 +42,15 @@ TEST_CASE("Simple objects", "[parser]") {
         obj = Parse("aba-caba");
         RequireSymbol(obj, "aba-caba");
     }
+    SECTION("Symbols are interned") {
+        auto obj = Parse("(abc abc 'abc)");
+        auto first = As<Cell>(obj)->GetFirst();
+        auto second = As<Cell>(As<Cell>(obj)->GetSecond())->GetFirst();
+        REQUIRE(first == second);
+        REQUIRE(first == Parse("abc"));
+        REQUIRE(As<Symbol>(first)->GetId() == Intern("abc"));
+        REQUIRE(Parse("#f") == Boolean(false));
+    }
     SECTION("Empty list") {
         auto obj = Parse("()");
         REQUIRE(obj == nullptr);
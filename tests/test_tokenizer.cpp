@@ -40,6 +40,13 @@ TEST_CASE("Basic tests", "[tokenizer]") {
     TestLine("42", {ConstantToken{42}});
     TestLine("-4", {ConstantToken{-4}});
     TestLine("+10", {ConstantToken{10}});
+    TestLine("9223372036854775807", {ConstantToken{kIntMax}});
+    TestLine("-9223372036854775808", {ConstantToken{kIntMin}});
+    TestLine("9223372036854775808",
+             {BigConstantToken{BigInt::FromDecimal("9223372036854775808", false)}});
+    TestLine("-100000000000000000000 1",
+             {BigConstantToken{BigInt::FromDecimal("100000000000000000000", true)},
+              ConstantToken{1}});
 
     TestLine("(", {BracketToken::OPEN});
     TestLine(")", {BracketToken::CLOSE});
@@ -102,6 +109,17 @@ TEST_CASE("Complex symbols", "[tokenizer]") {
     TestLine("aba-caba", {SymbolToken{"aba-caba"}});
 }
 
+TEST_CASE("String tokens", "[tokenizer]") {
+    TestLine("\"\"", {StringToken{""}});
+    TestLine("\"a (b) 'c\"", {StringToken{"a (b) 'c"}});
+    TestLine("\"a\\\"b\\\\c\\n\"", {StringToken{"a\"b\\c\n"}});
+    TestLine("(\"x\" 1)", {BracketToken::OPEN, StringToken{"x"}, ConstantToken{1},
+                           BracketToken::CLOSE});
+    REQUIRE_THROWS_AS(Parse("\"abc"), SyntaxError);
+    REQUIRE_THROWS_AS(Parse("\"abc\\"), SyntaxError);
+    REQUIRE_THROWS_AS(Parse("\"a\\qb\""), SyntaxError);
+}
+
 TEST_CASE("Constant token test", "[tokenizer]") {
     SECTION("Proper ints") {
         Int i = GENERATE(range(-10, 11));